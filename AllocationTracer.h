@@ -0,0 +1,129 @@
+/*
+  ==============================================================================
+
+    AllocationTracer.h
+    Created: 18 Oct 2026 9:41:06pm
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <mutex>
+#include <utility>
+
+/** Set to 1 in a test build to catch heap and lock use inside processBlock. */
+#ifndef NES_TRACE_ALLOCATIONS
+ #define NES_TRACE_ALLOCATIONS 0
+#endif
+
+/**
+ * Catches the audio thread touching the heap or taking a lock another thread holds. With
+ * NES_TRACE_ALLOCATIONS enabled, the global operator new and delete (replaced in PluginProcessor.cpp)
+ * and every TracedMutex report to the tracer, and any call made while a ScopedAudioThread is alive on
+ * the calling thread counts as a violation and trips an assertion, so a test run through any MIDI and
+ * automation stops at the offending call.
+ *
+ * The Synthesisers' own locks aren't traced: once the engine is built only the audio thread takes them.
+ *
+ * In normal builds ScopedAudioThread is empty, TracedMutex is a std::mutex and the operators are left
+ * alone.
+ */
+class AllocationTracer
+{
+public:
+   #if NES_TRACE_ALLOCATIONS
+    /**
+     * Marks the calling thread as rendering audio for its lifetime.
+     * @param realtime False for an offline render, which may wait for disk and locks.
+     */
+    struct ScopedAudioThread
+    {
+        explicit ScopedAudioThread(bool realtime = true) : active(realtime) { depth() += active ? 1 : 0; }
+        ~ScopedAudioThread() { depth() -= active ? 1 : 0; }
+
+        const bool active;
+    };
+
+    /** Called by the replaced allocation operators. */
+    static void heapUsed()
+    {
+        if (depth() > 0)
+            report(); // processBlock allocated or freed memory, see the call stack
+    }
+
+    /** Called by TracedMutex before it locks. */
+    static void lockUsed()
+    {
+        if (depth() > 0)
+            report(); // processBlock took a lock shared with another thread, see the call stack
+    }
+
+    /** Heap and lock calls made from inside processBlock since the plugin was loaded. */
+    static juce::uint32 getViolations()
+    {
+        return violations().load(std::memory_order_relaxed);
+    }
+
+   private:
+    static void report()
+    {
+        violations().fetch_add(1, std::memory_order_relaxed);
+
+        // logging the assertion allocates, which must not come back here
+        const int saved = std::exchange(depth(), 0);
+        jassertfalse;
+        depth() = saved;
+    }
+
+    static int& depth()
+    {
+        thread_local int d = 0;
+        return d;
+    }
+
+    static std::atomic<juce::uint32>& violations()
+    {
+        static std::atomic<juce::uint32> count { 0 };
+        return count;
+    }
+   #else
+    struct ScopedAudioThread
+    {
+        explicit ScopedAudioThread(bool = true) {}
+    };
+
+    static juce::uint32 getViolations() { return 0; }
+   #endif
+};
+
+#if NES_TRACE_ALLOCATIONS
+/** A std::mutex that reports to the AllocationTracer, for locks shared between threads. */
+class TracedMutex
+{
+public:
+    void lock()
+    {
+        AllocationTracer::lockUsed();
+        mutex.lock();
+    }
+
+    bool try_lock()
+    {
+        AllocationTracer::lockUsed();
+        return mutex.try_lock();
+    }
+
+    void unlock()
+    {
+        mutex.unlock();
+    }
+
+private:
+    std::mutex mutex;
+};
+#else
+using TracedMutex = std::mutex;
+#endif
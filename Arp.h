@@ -12,24 +12,74 @@
 
 #include <JuceHeader.h>
 #include <cmath>
+#include "TransportLFO.h"
+
+/**
+ * The set of held notes, kept as a 128-bit map so tracking them on the audio thread never allocates.
+ * Notes are indexed in ascending order, like the sorted set this replaces.
+ */
+class HeldNotes
+{
+public:
+    void add(int note)    { bits[(size_t) ((note & 127) >> 6)] |= bitFor(note); }
+    void remove(int note) { bits[(size_t) ((note & 127) >> 6)] &= ~bitFor(note); }
+    void clear()          { bits = {}; }
+
+    int size() const
+    {
+        return juce::countNumberOfBits(bits[0]) + juce::countNumberOfBits(bits[1]);
+    }
+
+    /** @return The index-th lowest held note, or -1 if fewer notes are held. */
+    int operator[](int index) const
+    {
+        for (int word = 0; word < 2; ++word)
+        {
+            const int count = juce::countNumberOfBits(bits[(size_t) word]);
+
+            if (index >= count)
+            {
+                index -= count;
+                continue;
+            }
+
+            for (int bit = 0; bit < 64; ++bit)
+                if ((bits[(size_t) word] >> bit) & 1 && index-- == 0)
+                    return word * 64 + bit;
+        }
+
+        return -1;
+    }
+
+    void saveState(juce::OutputStream& out) const
+    {
+        out.writeInt64((juce::int64) bits[0]);
+        out.writeInt64((juce::int64) bits[1]);
+    }
+
+    void restoreState(juce::InputStream& in)
+    {
+        bits[0] = (juce::uint64) in.readInt64();
+        bits[1] = (juce::uint64) in.readInt64();
+    }
+
+private:
+    static juce::uint64 bitFor(int note) { return (juce::uint64) 1 << (note & 63); }
+
+    std::array<juce::uint64, 2> bits {};
+};
 
 /**
  * A simple arpeggiator class that handles tempo synchronization with the host.
  * It manages the arpeggiation rate, note playback and integrates with the host's playback state.
+ *
+ * Steps are placed from the transport position alone and every step that falls inside a block is
+ * played, with the held notes as they are at that step's sample, so the notes come out at the same
+ * samples whatever size the host's blocks are.
  */
 class Arpeggiator
 {
 public:
-    
-    /**
-     * Sets the fallback beats per minute (BPM) if the host tempo is unavailable.
-     * @param _fallbackBPM The fallback tempo in BPM.
-     */
-    void setFallbackBPM(double _fallbackBPM)
-    {
-        fallbackBPM = _fallbackBPM;
-    }
-    
     /**
      * Sets the playback head for retrieving the current playback state from the host.
      * @param _playHead Pointer to the host's AudioPlayHead.
@@ -48,30 +98,6 @@ public:
         rate = _rate;
     }
     
-    /**
-     * Retrieves the current position in quarter notes, considering the host's playback position.
-     * @return Current position in quarter notes.
-     */
-    double getPositionInQuarterNotes()
-    {
-        if (playHead && playHead->getPosition() && playHead->getPosition()->getPpqPosition())
-            return *playHead->getPosition()->getPpqPosition();
-        
-        return positionInQuarterNotes;
-    }
-    
-    /**
-     * Retrieves the current BPM from the host, or uses the fallback BPM if unavailable.
-     * @return Current BPM.
-     */
-    double getBPM()
-    {
-        if (playHead && playHead->getPosition() && playHead->getPosition()->getBpm())
-            return *playHead->getPosition()->getBpm();
-        
-        return fallbackBPM;
-    }
-    
     /**
      * Checks if the playback is currently active.
      * @return True if playing, false otherwise.
@@ -94,22 +120,25 @@ public:
         notes.clear();
         noteIndex = 0;
         lastNote = -1;
+        isPlaying = false;
+        steps.ensureSize(stepBytes);
     }
     
     /**
      * Processes the audio and MIDI data for the current audio block.
      * This method should be called in each cycle of the audio processing loop.
-     * It calculates the timing for arpeggiation, handles MIDI note on/off messages, and triggers new notes when required.
+     * It works out where the arpeggiator's steps fall in the block, follows the note on/off messages up to
+     * each of them, and triggers a new note at every one.
      * @param buffer The buffer containing audio data.
-     * @param midiMessages The MIDI buffer containing incoming and outgoing MIDI messages.
+     * @param midiMessages The MIDI buffer containing incoming and outgoing MIDI messages. The steps are
+     *                     added to it at the end, so it doesn't allocate as long as the caller has
+     *                     reserved room for them.
+     * @param transport The host's position at the start of the block, or the processor's own count.
      */
-    void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+    void processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages, const TransportPosition& transport)
     {
         auto numSamples = buffer.getNumSamples();  // Get the number of samples in the current audio buffer.
         
-        positionInQuarterNotes = getPositionInQuarterNotes();  // Update current musical position in quarter notes.
-        double bpm = getBPM();  // Retrieve the current tempo in beats per minute from the host.
-        
         bool wasPlaying = isPlaying;  // Store the previous playing state.
         isPlaying = getIsPlaying();  // Update current playing state.
         
@@ -117,72 +146,104 @@ public:
         if (!wasPlaying && isPlaying)
             noteIndex = 0;
         
-        // Process all incoming MIDI messages to update note sets based on note on/off.
-        for (const auto event : midiMessages)
-        {
-            const auto message = event.getMessage();
-            auto noteNumber = message.getNoteNumber();
-            
-            if (message.isNoteOn())
-                notes.add(noteNumber);  // Add note number to the set of currently held notes if note on.
-            else if (message.isNoteOff())
-                notes.removeValue(noteNumber);  // Remove note number from the set if note off.
-        }
-        
-        // Calculate how many quarter notes occur per second, and how many samples represent one quarter note.
-        double quarterNotesPerSecond = bpm / 60.0;
-        double quarterNoteSamples = sampleRate / quarterNotesPerSecond;
-        double samplesToNextNote = numSamples;  // Initialize with the buffer size (will calculate exact samples to next note).
+        steps.clear();
+        auto input = midiMessages.begin();
         
-        // Define potential positions in quarter notes where notes could be triggered, based on the current arpeggiation rate.
-        double positions[] = {0.0, 0.125, 0.25, 0.375, 0.50, 0.625, 0.75, 0.875, 1.0};
-        int positionCount = sizeof(positions) / sizeof(positions[0]);
-        int skip = juce::jmax(1, (positionCount - 1) / rate);  // Calculate the skip in the positions array, based on rate.
+        // Step length in quarter notes: 1 for rate 1, down to 1/8 for rate 8.
+        const double stepLength = juce::jmax(1, 8 / juce::jmax(1, rate)) * 0.125;
         
-        // Calculate the next note's position in terms of samples.
-        for (int i = 0; i < positionCount; i += skip) {
-            double pos = positions[i];
-            double frac = positionInQuarterNotes - std::floor(positionInQuarterNotes);  // Fractional part of current position.
-            double distanceToNextNote = pos - frac;
-            samplesToNextNote = distanceToNextNote * quarterNoteSamples;
-            
-            // Break as soon as we find the next note position that is in the future.
-            if (samplesToNextNote >= 0)
-                break;
-        }
-        
-        // Trigger new notes if we have reached the time to play the next note within this buffer.
-        if (samplesToNextNote < numSamples)
+        if (transport.beatsPerSample > 0.0)
         {
-            // If there was a last note playing, send a note off message for it.
-            if (lastNote != -1)
+            for (auto step = (juce::int64) std::floor(transport.ppqAt(0) / stepLength); ; ++step)
             {
-                midiMessages.addEvent(juce::MidiMessage::noteOff(1, lastNote), samplesToNextNote);
-                lastNote = -1;
-            }
-            
-            // If there are notes held down, start the next note.
-            if (notes.size() > 0)
-            {
-                lastNote = notes[noteIndex];  // Get the next note to play.
-                noteIndex = (noteIndex + 1) % notes.size();  // Advance to the next note in the set.
-                midiMessages.addEvent(juce::MidiMessage::noteOn(1, lastNote, juce::uint8(127)), samplesToNextNote);
+                // the first sample at or after the step, counted from the transport's anchor so it is the
+                // same sample however the blocks are split; the tolerance keeps steps that land exactly on
+                // a sample there, rather than letting rounding in the position push them one either way
+                const double position = std::ceil((step * stepLength - transport.anchorPPQ) / transport.beatsPerSample - 1.0e-6)
+                                          - (double) transport.samplesFromAnchor;
+                
+                if (position >= numSamples)
+                    break;
+                
+                if (position < 0.0)
+                    continue;
+                
+                // notes pressed or released at or before the step count for it
+                for (; input != midiMessages.end() && (*input).samplePosition <= (int) position; ++input)
+                    followNote((*input).getMessage());
+                
+                playStep((int) position);
             }
         }
         
-        // Increment the musical position by the number of samples processed divided by samples per quarter note.
-        positionInQuarterNotes += numSamples / quarterNoteSamples;
+        for (; input != midiMessages.end(); ++input)
+            followNote((*input).getMessage());
+        
+        midiMessages.addEvents(steps, 0, -1, 0);
+    }
+
+    /** Writes the held notes and the position in the sequence, for an engine checkpoint. */
+    void saveState(juce::OutputStream& out) const
+    {
+        notes.saveState(out);
+        out.writeInt(noteIndex);
+        out.writeInt(lastNote);
+        out.writeBool(isPlaying);
+    }
+
+    void restoreState(juce::InputStream& in)
+    {
+        notes.restoreState(in);
+        noteIndex = in.readInt();
+        lastNote = in.readInt();
+        isPlaying = in.readBool();
     }
 
     
 private:
+    /** Adds or removes a held note. */
+    void followNote(const juce::MidiMessage& message)
+    {
+        if (message.isNoteOn())
+            notes.add(message.getNoteNumber());  // Add note number to the set of currently held notes if note on.
+        else if (message.isNoteOff())
+        {
+            notes.remove(message.getNoteNumber());  // Remove note number from the set if note off.
+
+            // a new chord after a full release starts from its first note, not wherever the last one stopped
+            if (notes.size() == 0)
+                noteIndex = 0;
+        }
+    }
+    
+    /** Ends the last step's note and starts the next held note. */
+    void playStep(int samplePosition)
+    {
+        // If there was a last note playing, send a note off message for it.
+        if (lastNote != -1)
+        {
+            steps.addEvent(juce::MidiMessage::noteOff(1, lastNote), samplePosition);
+            lastNote = -1;
+        }
+        
+        // If there are notes held down, start the next note.
+        if (notes.size() > 0)
+        {
+            lastNote = notes[noteIndex % notes.size()];  // Get the next note to play; notes may have been released since the last step.
+            noteIndex = (noteIndex + 1) % notes.size();  // Advance to the next note in the set.
+            steps.addEvent(juce::MidiMessage::noteOn(1, lastNote, juce::uint8(127)), samplePosition);
+        }
+    }
+    
+    /** Room for the steps of a block, two events each. */
+    static constexpr size_t stepBytes = 4096;
+    
     double sampleRate;
-    double positionInQuarterNotes;
     int rate = 1;
     int noteIndex = 0;
     int lastNote = -1;
-    bool isPlaying;
-    double fallbackBPM;
+    bool isPlaying = false;
     juce::AudioPlayHead* playHead;
-    juce::SortedSet<int> notes;
+    HeldNotes notes;
+    juce::MidiBuffer steps;
 };
@@ -1,44 +1,95 @@
 #pragma once
 
+#include <array>
 #include <cmath>
+#include <cstdint>
+#include <string>
+
+#include "Wavetable.h"
 
 /**
  * The Phasor class serves as a base for various oscillator implementations. It tracks the phase of
  * the oscillator and provides functionality to update the phase and calculate the output based on
  * the current phase. It supports setting the sample rate, frequency, and initial phase.
+ *
+ * The phase is a 32-bit unsigned fixed-point fraction of a cycle, so it wraps on overflow with no
+ * compare or branch, never drifts however long a note is held, and waveforms index their tables
+ * straight from the top bits. A plain uint32 per oscillator also keeps the layout friendly to
+ * integer SIMD across voices.
+ *
+ * Oscillators derive from Phasor<TheirOwnType> and provide a non-virtual output(uint32_t). The
+ * waveform is fixed at compile time, so processBlock inlines it into one tight loop that the compiler
+ * can unroll and vectorise; callers pick the oscillator once per block rather than per sample.
  */
 
+template <typename Waveform>
 class Phasor {
 
 public:
 
+    /** One full cycle in phase units. */
+    static constexpr double cycle = 4294967296.0;
+
     float process()
     {
-        phase += phaseDelta;
+        phase += phaseDelta; // wraps naturally at the end of the cycle
+        return static_cast<Waveform*>(this)->output(phase);
+    }
 
-        if (phase > 1.0)
+    /**
+     * Renders a block of samples.
+     * @param out Destination, overwritten.
+     * @param numSamples Number of samples to render.
+     */
+    void processBlock(float* out, int numSamples)
+    {
+        auto& waveform = *static_cast<Waveform*>(this);
+        uint32_t p = phase;
+
+        for (int i = 0; i < numSamples; ++i)
         {
-            phase -= 1.0f;
+            p += phaseDelta;
+            out[i] = waveform.output(p);
         }
-        return output(phase);
+
+        phase = p;
+    }
+
+    /** Moves the phase on as if numSamples had been rendered, without rendering them. */
+    void skip(int numSamples)
+    {
+        phase += phaseDelta * (uint32_t) numSamples;
+    }
+
+    /**
+     * Sets the phase to where the oscillator would be had it run at its current pitch from the first
+     * sample, exactly, since the phase wraps at 32 bits. Oscillators started on the same sample agree.
+     * @param numSamples Samples since the start.
+     */
+    void setPhaseFromStart(int64_t numSamples)
+    {
+        phase = phaseDelta * (uint32_t) numSamples;
     }
     
 
-    // Use this method to set the base frequency when a note starts
-    void setBaseFrequency(float freq) {
-        baseFrequency = freq;
-        setFrequency(freq); // Set the initial frequency with no pitch bend
+    /**
+     * Sets the phase step per sample directly, e.g. from NesTimerTables, instead of from a frequency.
+     * @param increment Fixed-point fraction of a cycle to advance each sample.
+     */
+    void setPhaseIncrement(uint32_t increment)
+    {
+        phaseDelta = increment;
+        frequency = (float) (increment / cycle * sampleRate);
     }
     
     void setPhase (float _phase)
     {
-        phase = _phase;
+        phase = (uint32_t) (_phase * cycle);
     }
 
-    virtual float output(float p)
-    {
-        return p;
-    }
+    /** The fixed-point phase exactly, for saving and restoring an oscillator's state. */
+    uint32_t getPhaseBits() const { return phase; }
+    void setPhaseBits(uint32_t bits) { phase = bits; }
 
     void setSampleRate(float SR)
     {
@@ -48,7 +99,7 @@ public:
     void setFrequency(float freq)
     {
         frequency = freq;
-        phaseDelta = frequency / sampleRate;
+        phaseDelta = (uint32_t) (frequency / sampleRate * cycle);
     }
     
     float getFrequency() const {
@@ -65,71 +116,108 @@ public:
    
     float getPhase()
     {
-        return phase;
+        return (float) (phase / cycle);
     }
     
 
 private:
-    float frequency;
-    float sampleRate;
-    float phase = 0.0f;
-    float phaseDelta;
-    std::atomic<float>* pitchBendRangeParam;
-    float baseFrequency;
+    float frequency = 0.0f;
+    float sampleRate = 44100.0f;
+    uint32_t phase = 0;
+    uint32_t phaseDelta = 0;
 };
 
 
-class TriOsc : public Phasor
+/** The 2A03 triangle sequence: 15 down to 0, then 0 up to 15, centred on zero. Built at compile time. */
+constexpr std::array<float, 32> makeTriangleSteps()
+{
+    std::array<float, 32> table {};
+    for (int i = 0; i < 32; ++i)
+    {
+        const int level = i < 16 ? 15 - i : i - 16;
+        table[(size_t) i] = (float) level * (0.5f / 15.0f) - 0.25f;
+    }
+    return table;
+}
+
+class TriOsc : public Phasor<TriOsc>
 {
     /**
-     * TriOsc class represents a triangle wave oscillator. It overrides the output function
-     * to generate a triangle wave based on the current phase.
+     * TriOsc class represents a triangle wave oscillator. Its output function generates
+     * the 2A03's 32-step, 4-bit triangle, indexed by the top five bits of the phase.
      */
+
+public:
     
-    float output(float p) override
+    float output(uint32_t p) const
     {
-        return fabsf(p - 0.5f) - 0.25f;
+        return steps[p >> 27];
     }
+
+private:
+    static constexpr std::array<float, 32> steps = makeTriangleSteps();
 };
 
-class SinOsc : public Phasor
+class TriLFO : public Phasor<TriLFO>
 {
     /**
-     * SinOsc class represents a sine wave oscillator. It overrides the output function
-     * to generate a sine wave based on the current phase.
+     * TriLFO is the smooth triangle for modulation. The 4-bit steps of TriOsc belong to the audible
+     * channel only; an LFO stepped like that would move the bit depth in coarse jumps.
      */
+
+public:
+
+    float output(uint32_t p) const
+    {
+        return std::fabs((float) (p / cycle) - 0.5f) - 0.25f;
+    }
+};
+
+class SinOsc : public Phasor<SinOsc>
+{
+    /**
+     * SinOsc class represents a sine wave oscillator. Its output function looks up
+     * a 1024-point sine table with the top ten bits of the phase.
+     */
+
+public:
     
-    float output(float p) override
+    float output(uint32_t p) const
     {
-        return sin(p * 2.0 * 3.14159);
+        return table[p >> 22];
     }
+
+private:
+    static std::array<float, 1024> makeTable()
+    {
+        std::array<float, 1024> sine {};
+        for (int i = 0; i < 1024; ++i)
+            sine[(size_t) i] = (float) std::sin(i * 2.0 * 3.14159265358979 / 1024.0);
+        return sine;
+    }
+
+    static inline const std::array<float, 1024> table = makeTable();
 };
 
-class SquareOsc : public Phasor
+class SquareOsc : public Phasor<SquareOsc>
 {
     /**
      * SquareOsc class represents a square wave oscillator with variable pulse width.
-     * It overrides the output function to generate a square wave based on the current phase
+     * Its output function generates a square wave based on the current phase
      * and pulse width.
      */
     
 public:
 
-    float output(float p) override
+    float output(uint32_t p) const
     {
-        float outVal = 0.5;
-
-        if (p > pulseWidth)
-        {
-            outVal = -0.5;
-        }
-        
-        return outVal;
+        // a single integer compare against the duty threshold, which compiles to a select
+        return p < pulseThreshold ? 0.5f : -0.5f;
     }
 
     void setPulseWidth(float pw)
     {
-        pulseWidth = pw;
+        pulseThreshold = (uint32_t) (pw * (cycle - 1.0));
     }
     
     /**
@@ -148,19 +236,48 @@ public:
     }
 
 private:
-    float pulseWidth = 0.5f;
+    uint32_t pulseThreshold = 0x80000000u;
 };
 
 
-class ASDROsc : public Phasor {
+class WavetableOsc : public Phasor<WavetableOsc>
+{
+    /**
+     * WavetableOsc plays a Wavetable, stepping through its steps once per cycle with no interpolation.
+     * The table isn't copied; it's one of the shared ExpansionTables and must outlive the oscillator's use of it.
+     */
+
+public:
+
+    float output(uint32_t p) const
+    {
+        // the step is the top bits of phase * length, so any table length works without a divide
+        return steps[((uint64_t) p * length) >> 32];
+    }
+
+    void setTable(const Wavetable& table)
+    {
+        steps = table.steps.data();
+        length = (uint32_t) table.length;
+    }
+
+private:
+    const float* steps = silence;
+    uint32_t length = 1;
+
+    static constexpr float silence[1] = { 0.0f };
+};
+
+class ASDROsc : public Phasor<ASDROsc> {
 public:
     /**
      * ASDROsc class represents an oscillator with an ADSR envelope applied to its output.
-     * It overrides the output function to shape the oscillator output according to the ADSR parameters, to control volume.
+     * Its output function shapes the oscillator output according to the ADSR parameters, to control volume.
      */
     
-    float output(float p) override 
+    float output(uint32_t phase) const
     {
+        const float p = (float) (phase / cycle);
         float outVal = 0; // Initialize output value
 
         // Attack phase
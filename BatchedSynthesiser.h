@@ -0,0 +1,411 @@
+/*
+  ==============================================================================
+
+    BatchedSynthesiser.h
+    Created: 18 Oct 2026 6:12:08pm
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * The MIDI of one block, read out of the MidiBuffer once and shared by every engine that renders the
+ * block. Storage is fixed, so filling it on the audio thread never allocates; system exclusive
+ * messages are skipped as nothing here uses them.
+ */
+class MidiEventList
+{
+public:
+    static constexpr int capacity = 1024;
+
+    struct Event
+    {
+        juce::MidiMessage message;
+        int samplePosition = 0;
+    };
+
+    /**
+     * Replaces the list with the events of a block.
+     * @param midi The block's MIDI.
+     * @param numSamples Block length; events are clamped into the block.
+     */
+    void fill(const juce::MidiBuffer& midi, int numSamples)
+    {
+        numEvents = 0;
+
+        for (const auto metadata : midi)
+        {
+            if (metadata.numBytes > 3)
+                continue;
+
+            if (numEvents == capacity)
+            {
+                ++droppedEvents;
+                continue;
+            }
+
+            auto& event = events[(size_t) numEvents++];
+            event.message = juce::MidiMessage(metadata.data, metadata.numBytes);
+            event.samplePosition = juce::jlimit(0, juce::jmax(0, numSamples - 1), metadata.samplePosition);
+        }
+    }
+
+    int size() const { return numEvents; }
+
+    const Event& operator[](int index) const { return events[(size_t) index]; }
+
+    /** Events that didn't fit since the list was created. */
+    int getDroppedEvents() const { return droppedEvents; }
+
+private:
+    std::array<Event, capacity> events;
+    int numEvents = 0;
+    int droppedEvents = 0;
+};
+
+//==============================================================================
+/**
+ * A voice that renders a whole block in one call. The Synthesiser's note on, note off and wheel calls
+ * arrive before rendering, each stamped with its sample position; they are queued here and applied at
+ * that position from inside the voice's own render loop, instead of the Synthesiser splitting the block
+ * around every event and calling every voice again for each piece.
+ *
+ * Subclasses implement noteStarted, noteStopped, pitchWheelChanged and renderVoice in place of the
+ * usual SynthesiserVoice callbacks, and call noteFinished when the note has died away.
+ */
+class BatchedVoice : public juce::SynthesiserVoice
+{
+public:
+    static constexpr int maxQueuedEvents = 128;
+
+    /** Points the voice at its engine's event clock; done by BatchedSynthesiser::addBatchedVoice. */
+    void setEventClock(const int* clock)
+    {
+        eventClock = clock;
+    }
+
+    void startNote(int midiNoteNumber, float velocity, juce::SynthesiserSound* sound, int currentPitchWheelPosition) final
+    {
+        ++pendingStarts;
+        queue({ VoiceEvent::Type::start, getEventTime(), midiNoteNumber, currentPitchWheelPosition, velocity, sound });
+    }
+
+    void stopNote(float velocity, bool allowTailOff) final
+    {
+        // the Synthesiser expects a hard stop to free the voice straight away, e.g. to steal it
+        if (! allowTailOff)
+            clearCurrentNote();
+
+        queue({ allowTailOff ? VoiceEvent::Type::release : VoiceEvent::Type::kill, getEventTime(), 0, 0, velocity, nullptr });
+    }
+
+    void pitchWheelMoved(int newValue) final
+    {
+        queue({ VoiceEvent::Type::wheel, getEventTime(), 0, newValue, 0.0f, nullptr });
+    }
+
+    void controllerMoved(int, int) override {}
+
+    /**
+     * Writes what the voice carries over from one note to the next, for an engine checkpoint. Whatever
+     * a note sets up when it starts is left out.
+     */
+    virtual void saveState(juce::OutputStream&) const {}
+
+    /** Reads back what saveState wrote. Only called while the voice is silent. */
+    virtual void restoreState(juce::InputStream&) {}
+
+    /**
+     * Renders the whole block, applying queued events at their positions.
+     * @param outputBuffer The buffer to add the voice into.
+     * @param startSample First sample of the block.
+     * @param numSamples Length of the block.
+     */
+    void renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples) final
+    {
+        const int endSample = startSample + numSamples;
+        int position = startSample;
+
+        for (int i = 0; i < numQueued; ++i)
+        {
+            const auto& event = events[(size_t) i];
+            const int eventPosition = juce::jlimit(position, endSample, startSample + event.samplePosition);
+
+            if (eventPosition > position)
+            {
+                renderVoice(outputBuffer, position, eventPosition - position);
+                position = eventPosition;
+            }
+
+            appliedPosition = eventPosition;
+            applyEvent(event);
+        }
+
+        numQueued = 0;
+
+        if (position < endSample)
+            renderVoice(outputBuffer, position, endSample - position);
+    }
+
+protected:
+    /** A note starts; same arguments as SynthesiserVoice::startNote. */
+    virtual void noteStarted(int midiNoteNumber, float velocity, juce::SynthesiserSound* sound, int currentPitchWheelPosition) = 0;
+
+    /** A note is released, or cut if allowTailOff is false. */
+    virtual void noteStopped(float velocity, bool allowTailOff) = 0;
+
+    /** The note's channel wheel moved. */
+    virtual void pitchWheelChanged(int) {}
+
+    /** An event posted with postControl has been reached. */
+    virtual void controlReached(int, float) {}
+
+    /** Renders a stretch of the block that contains no events. */
+    virtual void renderVoice(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples) = 0;
+
+    /**
+     * Called by the subclass when its note has finished sounding. The voice is only handed back to the
+     * Synthesiser if no later note is already queued on it.
+     */
+    void noteFinished()
+    {
+        if (pendingStarts == 0)
+            clearCurrentNote();
+    }
+
+    /** Sample position in the block of the event being delivered, e.g. to noteStarted. */
+    int getEventPosition() const
+    {
+        return appliedPosition;
+    }
+
+    /**
+     * Queues a voice-specific change, delivered to controlReached at the current event position.
+     * @param controlId Meaning defined by the subclass.
+     * @param value Value passed back.
+     */
+    void postControl(int controlId, float value)
+    {
+        queue({ VoiceEvent::Type::control, getEventTime(), controlId, 0, value, nullptr });
+    }
+
+private:
+    struct VoiceEvent
+    {
+        enum class Type { start, release, kill, wheel, control };
+
+        Type type;
+        int samplePosition;
+        int note;
+        int wheel;
+        float value;
+        juce::SynthesiserSound* sound;
+    };
+
+    int getEventTime() const
+    {
+        return eventClock != nullptr ? *eventClock : 0;
+    }
+
+    void queue(const VoiceEvent& event)
+    {
+        // a full queue means something is flooding one voice; keep the newest note ons and all note offs
+        jassert(numQueued < maxQueuedEvents);
+        if (numQueued == maxQueuedEvents)
+        {
+            appliedPosition = events[0].samplePosition;
+            applyEvent(events[0]);
+            std::move(events.begin() + 1, events.end(), events.begin());
+            --numQueued;
+        }
+
+        events[(size_t) numQueued++] = event;
+    }
+
+    void applyEvent(const VoiceEvent& event)
+    {
+        switch (event.type)
+        {
+            case VoiceEvent::Type::start:
+                --pendingStarts;
+                noteStarted(event.note, event.value, event.sound, event.wheel);
+                break;
+
+            case VoiceEvent::Type::release: noteStopped(event.value, true); break;
+            case VoiceEvent::Type::kill:    noteStopped(event.value, false); break;
+            case VoiceEvent::Type::wheel:   pitchWheelChanged(event.wheel); break;
+            case VoiceEvent::Type::control: controlReached(event.note, event.value); break;
+        }
+    }
+
+    const int* eventClock = nullptr;
+    std::array<VoiceEvent, maxQueuedEvents> events;
+    int numQueued = 0;
+    int pendingStarts = 0;
+    int appliedPosition = 0;
+};
+
+//==============================================================================
+/**
+ * Synthesiser that renders each block in a single pass. All of the block's MIDI is handed to the usual
+ * Synthesiser note handling up front, so voice allocation happens at the start of the block; the
+ * resulting voice calls are queued by each BatchedVoice with their sample positions. Every voice is
+ * then rendered once over the whole block, however many events it contains.
+ */
+class BatchedSynthesiser : public juce::Synthesiser
+{
+public:
+    BatchedSynthesiser()
+    {
+        pitchWheels.fill(0x2000); // centred, as the base class starts them
+    }
+
+    /**
+     * Renders a block.
+     * @param outputBuffer The buffer to add the voices into.
+     * @param events The block's MIDI, shared with the other engines.
+     * @param numSamples Block length, or -1 for the whole buffer.
+     */
+    void renderBlock(juce::AudioBuffer<float>& outputBuffer, const MidiEventList& events, int numSamples = -1)
+    {
+        const juce::ScopedLock sl(lock);
+
+        for (int i = 0; i < events.size(); ++i)
+        {
+            eventPosition = events[i].samplePosition;
+            handleMidiEvent(events[i].message);
+        }
+
+        eventPosition = 0;
+
+        renderVoices(outputBuffer, 0, numSamples < 0 ? outputBuffer.getNumSamples() : numSamples);
+    }
+
+    /** Adds a voice and connects it to this engine's event clock. */
+    void addBatchedVoice(BatchedVoice* voice)
+    {
+        voice->setEventClock(&eventPosition);
+        addVoice(voice);
+    }
+
+    /** True if any voice is playing a note, held or releasing. */
+    bool hasSoundingVoices() const
+    {
+        for (auto* voice : voices)
+            if (voice->isVoiceActive())
+                return true;
+
+        return false;
+    }
+
+    /**
+     * Writes the engine's state between blocks, for a checkpoint: the note each voice is playing, the
+     * channels' wheels and pedals, and what each voice carries over to its next note. A sounding voice
+     * is recorded by its note only, so a checkpoint taken with one sounding tells apart from a silent
+     * one but can't be restored.
+     */
+    virtual void saveState(juce::OutputStream& out) const
+    {
+        for (auto* voice : voices)
+            out.writeInt(voice->getCurrentlyPlayingNote());
+
+        for (auto wheel : pitchWheels)
+            out.writeInt(wheel);
+
+        out.writeInt((int) sustainPedals);
+        out.writeInt((int) sostenutoPedals);
+
+        for (auto* voice : voices)
+            static_cast<BatchedVoice*>(voice)->saveState(out);
+    }
+
+    /**
+     * Reads back a checkpoint taken with every voice silent. Not while the engine is rendering.
+     * @return False, with nothing changed, if a voice was sounding in the checkpoint.
+     */
+    virtual bool restoreState(juce::InputStream& in)
+    {
+        bool sounding = false;
+        for (int i = 0; i < voices.size(); ++i)
+            sounding = in.readInt() >= 0 || sounding;
+
+        if (sounding)
+            return false;
+
+        allNotesOff(0, false);
+
+        for (int channel = 1; channel <= numChannels; ++channel)
+        {
+            const int wheel = in.readInt();
+            if (wheel != pitchWheels[(size_t) channel - 1])
+                BatchedSynthesiser::handlePitchWheel(channel, wheel);
+        }
+
+        const auto sustain = (juce::uint32) in.readInt();
+        const auto sostenuto = (juce::uint32) in.readInt();
+
+        for (int channel = 1; channel <= numChannels; ++channel)
+        {
+            const auto bit = channelBit(channel);
+
+            if ((sustain & bit) != (sustainPedals & bit))
+                BatchedSynthesiser::handleSustainPedal(channel, (sustain & bit) != 0);
+
+            if ((sostenuto & bit) != (sostenutoPedals & bit))
+                BatchedSynthesiser::handleSostenutoPedal(channel, (sostenuto & bit) != 0);
+        }
+
+        for (auto* voice : voices)
+            static_cast<BatchedVoice*>(voice)->restoreState(in);
+
+        return true;
+    }
+
+    // the base class keeps the wheels and pedals to itself, so they are followed here for checkpoints
+    void handlePitchWheel(int midiChannel, int wheelValue) override
+    {
+        if (isChannel(midiChannel))
+            pitchWheels[(size_t) midiChannel - 1] = wheelValue;
+
+        juce::Synthesiser::handlePitchWheel(midiChannel, wheelValue);
+    }
+
+    void handleSustainPedal(int midiChannel, bool isDown) override
+    {
+        sustainPedals = isDown ? (sustainPedals | channelBit(midiChannel)) : (sustainPedals & ~channelBit(midiChannel));
+        juce::Synthesiser::handleSustainPedal(midiChannel, isDown);
+    }
+
+    void handleSostenutoPedal(int midiChannel, bool isDown) override
+    {
+        sostenutoPedals = isDown ? (sostenutoPedals | channelBit(midiChannel)) : (sostenutoPedals & ~channelBit(midiChannel));
+        juce::Synthesiser::handleSostenutoPedal(midiChannel, isDown);
+    }
+
+    void allNotesOff(int midiChannel, bool allowTailOff) override
+    {
+        sustainPedals = 0; // as the base class does
+        juce::Synthesiser::allNotesOff(midiChannel, allowTailOff);
+    }
+
+protected:
+    /** Sample position of the event being handled, read by voices as they queue calls. */
+    int eventPosition = 0;
+
+private:
+    static constexpr int numChannels = 16;
+
+    static bool isChannel(int midiChannel) { return midiChannel >= 1 && midiChannel <= numChannels; }
+
+    static juce::uint32 channelBit(int midiChannel)
+    {
+        return isChannel(midiChannel) ? 1u << (midiChannel - 1) : 0u;
+    }
+
+    std::array<int, numChannels> pitchWheels;
+    juce::uint32 sustainPedals = 0, sostenutoPedals = 0;
+};
@@ -11,39 +11,397 @@
 #pragma once
 #include <JuceHeader.h>
 
-class Sampler : public juce::Synthesiser
+#include "BatchedSynthesiser.h"
+#include "SampleSet.h"
+#include "SampleStream.h"
+#include <limits>
+
+/**
+ * The sampler's single sound. It plays whatever the current SampleSet maps to a note; the Sampler
+ * points it at the set picked up for each block.
+ */
+class SampleSetSound : public juce::SynthesiserSound
+{
+public:
+    bool appliesToNote(int midiNoteNumber) override
+    {
+        return currentSet != nullptr && currentSet->getSlotForNote(midiNoteNumber) != nullptr;
+    }
+
+    bool appliesToChannel(int) override { return true; }
+
+    const SampleSet* currentSet = nullptr;
+};
+
+/**
+ * Plays one sample of a SampleSet. Note ons and offs are applied at their sample positions inside the
+ * block, like the synth's voices. The voice holds on to the set it started from until the note ends,
+ * so a kit swapped in meanwhile doesn't cut it off.
+ *
+ * Long samples play their in-memory head and then carry on from the voice's SampleStream. Frames the
+ * stream can't supply in time play as silence and are counted as underruns.
+ */
+class SampleVoice : public BatchedVoice
+{
+public:
+    bool canPlaySound(juce::SynthesiserSound* sound) override
+    {
+        return dynamic_cast<const SampleSetSound*>(sound) != nullptr;
+    }
+
+    /** Gives the voice the stream it plays long samples through; done by Sampler::addSampleVoice. */
+    void setStream(std::unique_ptr<SampleStream> newStream)
+    {
+        stream = std::move(newStream);
+    }
+
+    SampleStream* getStream() const { return stream.get(); }
+
+    /**
+     * When set, an empty stream is read on the spot instead of underrunning. Offline rendering only:
+     * the rendering thread then takes the stream's lock and reads the file itself, which real-time
+     * rendering must never do.
+     */
+    void setSynchronousStreaming(bool shouldReadSynchronously)
+    {
+        synchronousStreaming = shouldReadSynchronously;
+    }
+
+    /**
+     * Lowers oldest to the generation of any set the voice still uses. Every set the stream has been
+     * asked to read from stays in use until the I/O thread has caught up with all requests, however
+     * many streamed notes started and stopped in the meantime.
+     */
+    void updateOldestInUse(juce::uint64& oldest)
+    {
+        if (streamedGeneration != noGeneration && stream->isIdle())
+            streamedGeneration = noGeneration;
+
+        oldest = juce::jmin(oldest, streamedGeneration);
+
+        if (playingSet != nullptr)
+            oldest = juce::jmin(oldest, playingSet->generation);
+    }
+
+protected:
+    void noteStarted(int midiNoteNumber, float velocity, juce::SynthesiserSound* sound, int) override
+    {
+        auto* setSound = static_cast<SampleSetSound*>(sound);
+        playingSet = setSound->currentSet;
+        playingSlot = playingSet != nullptr ? playingSet->getSlotForNote(midiNoteNumber) : nullptr;
+
+        if (playingSlot == nullptr)
+        {
+            stop();
+            return;
+        }
+
+        // in-memory slots are resampled to the host rate, this only corrects for the note, for a set
+        // that hasn't been rebuilt for a new rate yet, and for streamed slots which keep their own rate
+        pitchRatio = std::pow(2.0, (midiNoteNumber - playingSlot->rootNote) / 12.0)
+                       * playingSlot->sampleRate / getSampleRate();
+        sourceSamplePosition = 0.0;
+        gain = velocity;
+        released = false;
+
+        if (playingSlot->isStreamed() && stream != nullptr)
+        {
+            // only sets are freed, and only ones older than the oldest in use, so one generation pins them all
+            streamedGeneration = juce::jmin(streamedGeneration, playingSet->generation);
+            stream->start(*playingSlot);
+            endPosition = (double) (playingSlot->totalLength - 1);
+            windowIndex = 0;
+            staged = stagedCount = 0;
+            readFrame(0, current);
+            readFrame(1, next);
+        }
+        else
+        {
+            endPosition = (double) playingSlot->length;
+        }
+
+        adsr.setSampleRate(getSampleRate());
+        adsr.setParameters({ 0.0f, 0.0f, 1.0f, 0.1f });
+        adsr.noteOn();
+    }
+
+    void noteStopped(float, bool allowTailOff) override
+    {
+        if (allowTailOff)
+        {
+            adsr.noteOff();
+            released = true;
+        }
+        else
+            stop();
+    }
+
+    void renderVoice(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples) override
+    {
+        if (playingSlot == nullptr)
+            return;
+
+        float* outL = outputBuffer.getWritePointer(0, startSample);
+        float* outR = outputBuffer.getNumChannels() > 1 ? outputBuffer.getWritePointer(1, startSample) : nullptr;
+
+        if (playingSlot->isStreamed() && stream != nullptr)
+            renderStreamed(outL, outR, numSamples);
+        else
+            renderInMemory(outL, outR, numSamples);
+    }
+
+private:
+    static constexpr int stageSize = 64;
+
+    void renderInMemory(float* outL, float* outR, int numSamples)
+    {
+        const auto& data = playingSlot->data;
+        const float* inL = data.getReadPointer(0);
+        const float* inR = data.getNumChannels() > 1 ? data.getReadPointer(1) : nullptr;
+
+        // a note on its root plays the resampled data as it is; with no attack or decay the envelope
+        // holds at 1 until the release
+        if (pitchRatio == 1.0 && ! released)
+        {
+            const int pos = (int) sourceSamplePosition;
+            const int count = juce::jmin(numSamples, playingSlot->length - pos);
+
+            if (outR != nullptr)
+            {
+                juce::FloatVectorOperations::addWithMultiply(outL, inL + pos, gain, count);
+                juce::FloatVectorOperations::addWithMultiply(outR, (inR != nullptr ? inR : inL) + pos, gain, count);
+            }
+            else if (inR != nullptr)
+            {
+                juce::FloatVectorOperations::addWithMultiply(outL, inL + pos, gain * 0.5f, count);
+                juce::FloatVectorOperations::addWithMultiply(outL, inR + pos, gain * 0.5f, count);
+            }
+            else
+            {
+                juce::FloatVectorOperations::addWithMultiply(outL, inL + pos, gain, count);
+            }
+
+            sourceSamplePosition += count;
+
+            if (sourceSamplePosition >= endPosition)
+                stop();
+
+            return;
+        }
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const int pos = (int) sourceSamplePosition;
+            const float alpha = (float) (sourceSamplePosition - pos);
+            const float invAlpha = 1.0f - alpha;
+
+            const float l = inL[pos] * invAlpha + inL[pos + 1] * alpha;
+            const float r = inR != nullptr ? inR[pos] * invAlpha + inR[pos + 1] * alpha : l;
+
+            if (! writeFrame(l, r, outL, outR, i))
+                break;
+        }
+    }
+
+    void renderStreamed(float* outL, float* outR, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto index = (juce::int64) sourceSamplePosition;
+
+            while (windowIndex < index)
+            {
+                current[0] = next[0];
+                current[1] = next[1];
+                readFrame(++windowIndex + 1, next);
+            }
+
+            const float alpha = (float) (sourceSamplePosition - (double) index);
+            const float l = current[0] + (next[0] - current[0]) * alpha;
+            const float r = current[1] + (next[1] - current[1]) * alpha;
+
+            if (! writeFrame(l, r, outL, outR, i))
+                break;
+        }
+    }
+
+    /** Adds one enveloped frame to the output and advances. @return False once the note has ended. */
+    bool writeFrame(float l, float r, float* outL, float* outR, int i)
+    {
+        const float envelope = adsr.getNextSample() * gain;
+        l *= envelope;
+        r *= envelope;
+
+        if (outR != nullptr)
+        {
+            outL[i] += l;
+            outR[i] += r;
+        }
+        else
+        {
+            outL[i] += (l + r) * 0.5f;
+        }
+
+        sourceSamplePosition += pitchRatio;
+
+        if (sourceSamplePosition >= endPosition || ! adsr.isActive())
+        {
+            stop();
+            return false;
+        }
+
+        return true;
+    }
+
+    /** Reads the frame at index of a streamed slot, from the head or, past it, from the stream in order. */
+    void readFrame(juce::int64 index, float* frame)
+    {
+        if (index < playingSlot->length)
+        {
+            const auto& data = playingSlot->data;
+            frame[0] = data.getSample(0, (int) index) * playingSlot->gain;
+            frame[1] = data.getNumChannels() > 1 ? data.getSample(1, (int) index) * playingSlot->gain : frame[0];
+            return;
+        }
+
+        if (staged == stagedCount)
+        {
+            staged = 0;
+            stagedCount = stream->read(stage[0], stage[1], stageSize);
+
+            if (stagedCount == 0 && synchronousStreaming)
+            {
+                stream->readNow();
+                stagedCount = stream->read(stage[0], stage[1], stageSize);
+            }
+
+            if (stagedCount == 0)
+            {
+                stream->countUnderrun();
+                frame[0] = frame[1] = 0.0f;
+                return;
+            }
+        }
+
+        frame[0] = stage[0][staged];
+        frame[1] = stage[1][staged];
+        ++staged;
+    }
+
+    void stop()
+    {
+        if (playingSlot != nullptr && playingSlot->isStreamed() && stream != nullptr)
+            stream->stop();
+
+        adsr.reset();
+        playingSet = nullptr;
+        playingSlot = nullptr;
+        noteFinished();
+    }
+
+    const SampleSet* playingSet = nullptr;
+    const SampleSlot* playingSlot = nullptr;
+    juce::ADSR adsr;
+    double pitchRatio = 1.0;
+    double sourceSamplePosition = 0.0;
+    double endPosition = 0.0;
+    float gain = 0.0f;
+    bool released = false;
+
+    // streaming; the oldest set the stream has been sent to since it was last idle
+    static constexpr juce::uint64 noGeneration = std::numeric_limits<juce::uint64>::max();
+    std::unique_ptr<SampleStream> stream;
+    juce::uint64 streamedGeneration = noGeneration;
+    bool synchronousStreaming = false;
+    juce::int64 windowIndex = 0;
+    float current[2] {}, next[2] {};
+    float stage[2][stageSize] {};
+    int staged = 0, stagedCount = 0;
+};
+
+/**
+ * Drum sampler for the noise channel mode. The kit is loaded and swapped by a SampleSetLoader, so
+ * samples and note mappings can be changed at runtime without touching the audio thread. Long
+ * samples are streamed by the voices' SampleStreams, all serviced by one I/O thread.
+ */
+class Sampler : public BatchedSynthesiser
 {
 public:
     
     Sampler(){
         
-        formatManager.registerBasicFormats();
+        addSound(sound = new SampleSetSound());
+        ioThread.startThread();
     }
-    
-    void setSample(const void* sourceData, size_t sourceDataSize, int startMidiNote, int endMidiNote)
+
+    ~Sampler() override
     {
-        // Allows us to use WAV and AIFF files
-        
-        
-        // Create a MemoryInputStream for the source data
-        std::unique_ptr<juce::MemoryInputStream> inputStream(new juce::MemoryInputStream(sourceData, sourceDataSize, false));
+        // the streams belong to the voices, which the base class deletes after this
+        ioThread.stopThread(4000);
+    }
 
-        // Create an AudioFormatReader for the MemoryInputStream
-        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(std::move(inputStream)));
-        
-        // Create a BigInteger with the specified range of MIDI notes
-        juce::BigInteger noteRange;
-        noteRange.setRange(startMidiNote, endMidiNote - startMidiNote + 1, true);
+    /** Adds a voice along with a stream for it, serviced by the sampler's I/O thread. */
+    void addSampleVoice(SampleVoice* voice)
+    {
+        voice->setStream(std::make_unique<SampleStream>(loader));
+        ioThread.addTimeSliceClient(voice->getStream());
+        addBatchedVoice(voice);
+    }
 
-        // Add the sample with the specified MIDI note range
-        addSound(new juce::SamplerSound("default", *reader, noteRange, startMidiNote, 0, 0.1, 10));
+    /** Switches the voices to reading streams synchronously; offline rendering only, see SampleVoice. */
+    void setSynchronousStreaming(bool shouldReadSynchronously)
+    {
+        for (int i = 0; i < getNumVoices(); ++i)
+            static_cast<SampleVoice*>(getVoice(i))->setSynchronousStreaming(shouldReadSynchronously);
+    }
+
+    /** Total frames played as silence because a stream fell behind, for diagnostics. */
+    juce::uint32 getStreamUnderruns() const
+    {
+        juce::uint32 total = 0;
+
+        for (auto* voice : voices)
+            if (auto* stream = static_cast<SampleVoice*>(voice)->getStream())
+                total += stream->getUnderruns();
+
+        return total;
+    }
+
+    SampleSetLoader& getLoader() { return loader; }
+    const SampleSetLoader& getLoader() const { return loader; }
+
+    /**
+     * Renders a block from the current kit.
+     * @param outputBuffer The buffer to add the samples into.
+     * @param events The block's MIDI, shared with the other engines.
+     */
+    void renderBlock(juce::AudioBuffer<float>& outputBuffer, const MidiEventList& events)
+    {
+        sound->currentSet = loader.beginBlock();
+        BatchedSynthesiser::renderBlock(outputBuffer, events);
+        endBlock();
+    }
+
+    /** Keeps set reclamation going through blocks in which the sampler isn't rendered. */
+    void skipBlock()
+    {
+        sound->currentSet = loader.beginBlock();
+        endBlock();
     }
 
-    
-    
 private:
+    void endBlock()
+    {
+        auto oldest = sound->currentSet != nullptr ? sound->currentSet->generation : std::numeric_limits<juce::uint64>::max();
+
+        for (int i = 0; i < getNumVoices(); ++i)
+            static_cast<SampleVoice*>(getVoice(i))->updateOldestInUse(oldest);
 
-    juce::AudioFormatManager formatManager;
+        loader.endBlock(oldest);
+    }
+
+    SampleSetLoader loader;
+    SampleSetSound* sound = nullptr;
+    juce::TimeSliceThread ioThread { "Sample streaming" };
     
 };
-
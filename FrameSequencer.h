@@ -0,0 +1,359 @@
+/*
+  ==============================================================================
+
+    FrameSequencer.h
+    Created: 18 Oct 2026 2:48:19pm
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+/**
+ * The 2A03 frame sequencer in its 4-step mode. It clocks envelopes and the triangle's linear counter
+ * on every quarter frame (~240 Hz) and length counters on every half frame (~120 Hz). Everything it
+ * drives is evaluated only on those ticks, so between ticks a voice just multiplies by a held gain.
+ *
+ * The tick period is kept as a whole number of samples plus a 32-bit fraction, so tick positions
+ * never drift no matter how long a note is held.
+ */
+class FrameSequencer
+{
+public:
+    /** NTSC 2A03 CPU clock in Hz. */
+    static constexpr double cpuClock = 1789773.0;
+
+    /** CPU clock divided by the 7457.5-cycle quarter-frame period. */
+    static constexpr double quarterFrameRate = cpuClock / 7457.5;
+
+    /**
+     * Sets the sample rate the tick period is measured in.
+     * @param sampleRate The audio sample rate.
+     */
+    void setSampleRate(double sampleRate)
+    {
+        const double period = sampleRate / quarterFrameRate;
+        wholeSamples = (int) period;
+        fraction = (uint32_t) ((period - wholeSamples) * 4294967296.0);
+    }
+
+    /** Restarts the sequence so the next sample is a quarter-frame tick. */
+    void reset()
+    {
+        samplesUntilTick = 0;
+        fractionAccumulator = 0;
+        step = 3;
+    }
+
+    /** @return How many samples can be rendered before the next tick is due; 0 means tick now. */
+    int getSamplesUntilTick() const
+    {
+        return samplesUntilTick;
+    }
+
+    /**
+     * Advances the clock by a run of samples rendered with the current gain.
+     * @param numSamples Number of samples rendered, no more than getSamplesUntilTick().
+     */
+    void advance(int numSamples)
+    {
+        samplesUntilTick -= numSamples;
+    }
+
+    /**
+     * Performs a due tick and schedules the next one.
+     * @return True if this quarter frame is also a half frame.
+     */
+    bool tick()
+    {
+        const uint32_t previous = fractionAccumulator;
+        fractionAccumulator += fraction;
+        samplesUntilTick += wholeSamples + (fractionAccumulator < previous ? 1 : 0);
+
+        step = (step + 1) & 3;
+        return (step & 1) != 0;
+    }
+
+private:
+    int wholeSamples = 183;
+    uint32_t fraction = 0;
+    uint32_t fractionAccumulator = 0;
+    int samplesUntilTick = 0;
+    int step = 3;
+};
+
+/**
+ * ADSR envelope clocked by the frame sequencer. The level moves once per quarter frame and the output
+ * is quantised to the APU's 4-bit volume, so the per-sample path only sees a held gain in 1/15 steps.
+ */
+class EnvelopeUnit
+{
+public:
+    enum class Stage { idle, attack, decay, sustain, release };
+
+    /**
+     * Sets the envelope shape. Times are converted to quarter-frame ticks, so anything shorter than a
+     * tick (~4 ms) happens in a single step.
+     * @param attack Attack time in seconds.
+     * @param decay Decay time in seconds.
+     * @param sustain Sustain level, 0 to 1.
+     * @param release Release time in seconds.
+     */
+    void setParameters(float attack, float decay, float sustain, float release)
+    {
+        attackStep = stepForTime(attack);
+        decayStep = stepForTime(decay);
+        sustainLevel = sustain < 0.0f ? 0.0f : (sustain > 1.0f ? 1.0f : sustain);
+        releaseStep = stepForTime(release);
+    }
+
+    void noteOn()
+    {
+        stage = Stage::attack;
+        level = 0.0f;
+        volume = 0;
+    }
+
+    void noteOff()
+    {
+        if (stage != Stage::idle)
+            stage = Stage::release;
+    }
+
+    /** Silences the envelope immediately. */
+    void reset()
+    {
+        stage = Stage::idle;
+        level = 0.0f;
+        volume = 0;
+    }
+
+    /** Quarter-frame clock. */
+    void clock()
+    {
+        switch (stage)
+        {
+            case Stage::attack:
+                level += attackStep;
+                if (level >= 1.0f)
+                {
+                    level = 1.0f;
+                    stage = Stage::decay;
+                }
+                break;
+
+            case Stage::decay:
+                level -= decayStep * (1.0f - sustainLevel);
+                if (level <= sustainLevel)
+                {
+                    level = sustainLevel;
+                    stage = sustainLevel > 0.0f ? Stage::sustain : Stage::idle;
+                }
+                break;
+
+            case Stage::release:
+                level -= releaseStep;
+                if (level <= 0.0f)
+                {
+                    level = 0.0f;
+                    stage = Stage::idle;
+                }
+                break;
+
+            case Stage::sustain:
+            case Stage::idle:
+                break;
+        }
+
+        volume = (int) (level * 15.0f + 0.5f);
+    }
+
+    /** @return The current 4-bit volume, 0 to 15. */
+    int getVolume() const
+    {
+        return volume;
+    }
+
+    /** @return The current volume as a gain, 0 to 1. */
+    float getGain() const
+    {
+        return (float) volume * (1.0f / 15.0f);
+    }
+
+    Stage getStage() const
+    {
+        return stage;
+    }
+
+    bool isActive() const
+    {
+        return stage != Stage::idle;
+    }
+
+private:
+    static float stepForTime(float seconds)
+    {
+        const float ticks = seconds * (float) FrameSequencer::quarterFrameRate;
+        return ticks > 1.0f ? 1.0f / ticks : 1.0f;
+    }
+
+    Stage stage = Stage::idle;
+    float level = 0.0f;
+    int volume = 0;
+
+    float attackStep = 1.0f;
+    float decayStep = 1.0f;
+    float sustainLevel = 1.0f;
+    float releaseStep = 1.0f;
+};
+
+/**
+ * Down-counter that silences a channel when it reaches zero. Clocked on half frames it behaves as the
+ * APU length counter; clocked on quarter frames it is the triangle's linear counter.
+ */
+class LengthCounter
+{
+public:
+    /**
+     * Loads the counter.
+     * @param ticks Number of clocks before the channel is silenced.
+     */
+    void load(int ticks)
+    {
+        counter = ticks > 0 ? ticks : 0;
+    }
+
+    /** While halted the counter holds its value, like the APU's halt / control flag. */
+    void setHalted(bool shouldHalt)
+    {
+        halted = shouldHalt;
+    }
+
+    void clock()
+    {
+        if (! halted && counter > 0)
+            --counter;
+    }
+
+    bool isSilenced() const
+    {
+        return counter == 0;
+    }
+
+    /**
+     * Converts a duration to clocks of this counter.
+     * @param seconds Duration in seconds.
+     * @param clocksPerSecond FrameSequencer::quarterFrameRate, or half of it for a length counter.
+     */
+    static int ticksForTime(float seconds, double clocksPerSecond)
+    {
+        return (int) std::ceil(seconds * clocksPerSecond);
+    }
+
+private:
+    int counter = 0;
+    bool halted = false;
+};
+
+/**
+ * Pulse channel sweep unit. It owns the channel's 11-bit timer period and, on half frames, moves it by
+ * period >> shift every (dividerPeriod + 1) half frames. The two pulse channels differ only in how they
+ * negate: pulse 1 adds the ones' complement (one lower than pulse 2), pulse 2 the two's complement.
+ * The result is applied as a single change of the period register; the oscillator only has to pick up
+ * a new phase increment when clock() reports one.
+ */
+class SweepUnit
+{
+public:
+    enum class Negate { onesComplement, twosComplement };
+
+    static constexpr int maxTimerPeriod = 0x7ff;
+
+    explicit SweepUnit(Negate _negateMode) : negateMode(_negateMode)
+    {
+    }
+
+    /**
+     * Sets the sweep register.
+     * @param _enabled Whether the sweep moves the period at all.
+     * @param _dividerPeriod Half frames between updates, minus one (0 to 7).
+     * @param _shift Right shift applied to the period to get the change amount (0 to 7).
+     * @param _negate True to sweep upwards in pitch.
+     */
+    void setParameters(bool _enabled, int _dividerPeriod, int _shift, bool _negate)
+    {
+        enabled = _enabled;
+        dividerPeriod = _dividerPeriod & 7;
+        shift = _shift & 7;
+        negate = _negate;
+        reload = true;
+    }
+
+    /** Loads the channel's timer period, as a note on writes the timer registers. */
+    void setTimerPeriod(int period)
+    {
+        timerPeriod = period < 0 ? 0 : (period > maxTimerPeriod ? maxTimerPeriod : period);
+    }
+
+    int getTimerPeriod() const
+    {
+        return timerPeriod;
+    }
+
+    /** The channel is silenced while its period is below 8 or the sweep target overflows 11 bits. */
+    bool isMuting() const
+    {
+        return timerPeriod < 8 || getTargetPeriod() > maxTimerPeriod;
+    }
+
+    /**
+     * Half-frame clock.
+     * @return True if the timer period changed.
+     */
+    bool clock()
+    {
+        bool changed = false;
+
+        if (divider == 0 && enabled && shift > 0 && ! isMuting())
+        {
+            timerPeriod = getTargetPeriod();
+            changed = true;
+        }
+
+        if (divider == 0 || reload)
+        {
+            divider = dividerPeriod;
+            reload = false;
+        }
+        else
+        {
+            --divider;
+        }
+
+        return changed;
+    }
+
+private:
+    int getTargetPeriod() const
+    {
+        const int change = timerPeriod >> shift;
+
+        if (! negate)
+            return timerPeriod + change;
+
+        return timerPeriod - change - (negateMode == Negate::onesComplement ? 1 : 0);
+    }
+
+    Negate negateMode;
+    bool enabled = false;
+    bool negate = false;
+    bool reload = false;
+    int dividerPeriod = 0;
+    int shift = 0;
+    int divider = 0;
+    int timerPeriod = 0;
+};
@@ -0,0 +1,420 @@
+/*
+  ==============================================================================
+
+    Freeverb.h
+    Created: 19 Oct 2026 2:21:09am
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <vector>
+
+/**
+ * Jezar's Freeverb, ported from juce::Reverb so that its delay lines and parameter ramps can be saved
+ * and restored; juce::Reverb keeps them private. The arithmetic and its order are the same as
+ * juce::Reverb's, so the output is too, sample for sample.
+ *
+ * A reverb whose lines have all decayed to exactly zero (JUCE_UNDENORMALISE flushes them) saves as
+ * silent, without its lines or their read positions, which then make no difference to the output.
+ */
+class Freeverb
+{
+public:
+    using Parameters = juce::Reverb::Parameters;
+
+    Freeverb()
+    {
+        setParameters(Parameters());
+        setSampleRate(44100.0);
+    }
+
+    const Parameters& getParameters() const noexcept { return parameters; }
+
+    /** Applies new parameters, ramped over 10 ms as juce::Reverb does. */
+    void setParameters(const Parameters& newParams)
+    {
+        const float wetScaleFactor = 3.0f;
+        const float dryScaleFactor = 2.0f;
+
+        const float wet = newParams.wetLevel * wetScaleFactor;
+        dryGain.setTarget(newParams.dryLevel * dryScaleFactor);
+        wetGain1.setTarget(0.5f * wet * (1.0f + newParams.width));
+        wetGain2.setTarget(0.5f * wet * (1.0f - newParams.width));
+
+        gain = isFrozen(newParams.freezeMode) ? 0.0f : 0.015f;
+        parameters = newParams;
+        updateDamping();
+    }
+
+    /** Sizes the lines for a sample rate and clears them. Allocates, so not for the audio thread. */
+    void setSampleRate(double sampleRate)
+    {
+        static const short combTunings[] = { 1116, 1188, 1277, 1356, 1422, 1491, 1557, 1617 }; // (at 44100Hz)
+        static const short allPassTunings[] = { 556, 441, 341, 225 };
+        const int stereoSpread = 23;
+        const int intSampleRate = (int) sampleRate;
+
+        for (int i = 0; i < numCombs; ++i)
+        {
+            comb[0][i].setSize((intSampleRate * combTunings[i]) / 44100);
+            comb[1][i].setSize((intSampleRate * (combTunings[i] + stereoSpread)) / 44100);
+        }
+
+        for (int i = 0; i < numAllPasses; ++i)
+        {
+            allPass[0][i].setSize((intSampleRate * allPassTunings[i]) / 44100);
+            allPass[1][i].setSize((intSampleRate * (allPassTunings[i] + stereoSpread)) / 44100);
+        }
+
+        const double smoothTime = 0.01;
+        damping.reset(sampleRate, smoothTime);
+        feedback.reset(sampleRate, smoothTime);
+        dryGain.reset(sampleRate, smoothTime);
+        wetGain1.reset(sampleRate, smoothTime);
+        wetGain2.reset(sampleRate, smoothTime);
+    }
+
+    /** Clears the lines. */
+    void reset()
+    {
+        for (int j = 0; j < numChannels; ++j)
+        {
+            for (int i = 0; i < numCombs; ++i)
+                comb[j][i].clear();
+
+            for (int i = 0; i < numAllPasses; ++i)
+                allPass[j][i].clear();
+        }
+    }
+
+    void processStereo(float* const left, float* const right, const int numSamples) noexcept
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const float input = (left[i] + right[i]) * gain;
+            float outL = 0, outR = 0;
+
+            const float damp = damping.getNext();
+            const float feedbck = feedback.getNext();
+
+            for (int j = 0; j < numCombs; ++j) // accumulate the comb filters in parallel
+            {
+                outL += comb[0][j].process(input, damp, feedbck);
+                outR += comb[1][j].process(input, damp, feedbck);
+            }
+
+            for (int j = 0; j < numAllPasses; ++j) // run the allpass filters in series
+            {
+                outL = allPass[0][j].process(outL);
+                outR = allPass[1][j].process(outR);
+            }
+
+            const float dry = dryGain.getNext();
+            const float wet1 = wetGain1.getNext();
+            const float wet2 = wetGain2.getNext();
+
+            left[i] = outL * wet1 + outR * wet2 + left[i] * dry;
+            right[i] = outR * wet1 + outL * wet2 + right[i] * dry;
+        }
+    }
+
+    void processMono(float* const samples, const int numSamples) noexcept
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const float input = samples[i] * gain;
+            float output = 0;
+
+            const float damp = damping.getNext();
+            const float feedbck = feedback.getNext();
+
+            for (int j = 0; j < numCombs; ++j) // accumulate the comb filters in parallel
+                output += comb[0][j].process(input, damp, feedbck);
+
+            for (int j = 0; j < numAllPasses; ++j) // run the allpass filters in series
+                output = allPass[0][j].process(output);
+
+            const float dry = dryGain.getNext();
+            const float wet1 = wetGain1.getNext();
+
+            samples[i] = output * wet1 + samples[i] * dry;
+        }
+    }
+
+    /** True if every line holds nothing but zeros. */
+    bool isSilent() const
+    {
+        for (int j = 0; j < numChannels; ++j)
+        {
+            for (int i = 0; i < numCombs; ++i)
+                if (! comb[j][i].isSilent())
+                    return false;
+
+            for (int i = 0; i < numAllPasses; ++i)
+                if (! allPass[j][i].isSilent())
+                    return false;
+        }
+
+        return true;
+    }
+
+    /** Writes the parameters, ramps and, unless silent, the lines. */
+    void saveState(juce::OutputStream& out) const
+    {
+        out.writeFloat(parameters.roomSize);
+        out.writeFloat(parameters.damping);
+        out.writeFloat(parameters.wetLevel);
+        out.writeFloat(parameters.dryLevel);
+        out.writeFloat(parameters.width);
+        out.writeFloat(parameters.freezeMode);
+        out.writeFloat(gain);
+
+        for (auto* ramp : { &damping, &feedback, &dryGain, &wetGain1, &wetGain2 })
+            ramp->saveState(out);
+
+        const bool silent = isSilent();
+        out.writeBool(silent);
+
+        if (silent)
+            return;
+
+        for (int j = 0; j < numChannels; ++j)
+        {
+            for (int i = 0; i < numCombs; ++i)
+                comb[j][i].saveState(out);
+
+            for (int i = 0; i < numAllPasses; ++i)
+                allPass[j][i].saveState(out);
+        }
+    }
+
+    /**
+     * Reads back what saveState wrote.
+     * @return False if the lines were saved at another sample rate; the reverb is then cleared.
+     */
+    bool restoreState(juce::InputStream& in)
+    {
+        parameters.roomSize = in.readFloat();
+        parameters.damping = in.readFloat();
+        parameters.wetLevel = in.readFloat();
+        parameters.dryLevel = in.readFloat();
+        parameters.width = in.readFloat();
+        parameters.freezeMode = in.readFloat();
+        gain = in.readFloat();
+
+        for (auto* ramp : { &damping, &feedback, &dryGain, &wetGain1, &wetGain2 })
+            ramp->restoreState(in);
+
+        reset();
+
+        if (in.readBool())
+            return true;
+
+        bool restored = true;
+
+        for (int j = 0; j < numChannels; ++j)
+        {
+            for (int i = 0; i < numCombs; ++i)
+                restored = restored && comb[j][i].restoreState(in);
+
+            for (int i = 0; i < numAllPasses; ++i)
+                restored = restored && allPass[j][i].restoreState(in);
+        }
+
+        if (! restored)
+            reset();
+
+        return restored;
+    }
+
+private:
+    static bool isFrozen(const float freezeMode) noexcept { return freezeMode >= 0.5f; }
+
+    void updateDamping() noexcept
+    {
+        const float roomScaleFactor = 0.28f;
+        const float roomOffset = 0.7f;
+        const float dampScaleFactor = 0.4f;
+
+        if (isFrozen(parameters.freezeMode))
+            setDamping(0.0f, 1.0f);
+        else
+            setDamping(parameters.damping * dampScaleFactor, parameters.roomSize * roomScaleFactor + roomOffset);
+    }
+
+    void setDamping(const float dampingToUse, const float roomSizeToUse) noexcept
+    {
+        damping.setTarget(dampingToUse);
+        feedback.setTarget(roomSizeToUse);
+    }
+
+    /** juce::SmoothedValue<float> with linear smoothing, with its countdown where it can be saved. */
+    struct Ramp
+    {
+        void reset(double sampleRate, double rampLengthInSeconds)
+        {
+            stepsToTarget = (int) std::floor(rampLengthInSeconds * sampleRate);
+            current = target;
+            countdown = 0;
+        }
+
+        void setTarget(float newValue)
+        {
+            if (newValue == target)
+                return;
+
+            if (stepsToTarget <= 0)
+            {
+                current = target = newValue;
+                countdown = 0;
+                return;
+            }
+
+            target = newValue;
+            countdown = stepsToTarget;
+            step = (target - current) / (float) countdown;
+        }
+
+        float getNext()
+        {
+            if (countdown <= 0)
+                return target;
+
+            --countdown;
+
+            if (countdown > 0)
+                current += step;
+            else
+                current = target;
+
+            return current;
+        }
+
+        // the step only matters while ramping, and is worked out afresh for the next ramp
+        void saveState(juce::OutputStream& out) const
+        {
+            out.writeFloat(current);
+            out.writeFloat(target);
+            out.writeInt(countdown);
+
+            if (countdown > 0)
+                out.writeFloat(step);
+        }
+
+        void restoreState(juce::InputStream& in)
+        {
+            current = in.readFloat();
+            target = in.readFloat();
+            countdown = in.readInt();
+            step = countdown > 0 ? in.readFloat() : 0.0f;
+        }
+
+        float current = 0.0f, target = 0.0f, step = 0.0f;
+        int countdown = 0, stepsToTarget = 0;
+    };
+
+    /** A delay line; the comb keeps a one-pole low-pass in its feedback. */
+    struct Line
+    {
+        void setSize(const int size)
+        {
+            if (size != (int) buffer.size())
+            {
+                bufferIndex = 0;
+                buffer.assign((size_t) juce::jmax(1, size), 0.0f);
+            }
+
+            clear();
+        }
+
+        void clear() noexcept
+        {
+            last = 0.0f;
+            std::fill(buffer.begin(), buffer.end(), 0.0f);
+        }
+
+        bool isSilent() const
+        {
+            if (last != 0.0f)
+                return false;
+
+            for (auto sample : buffer)
+                if (sample != 0.0f)
+                    return false;
+
+            return true;
+        }
+
+        void saveState(juce::OutputStream& out) const
+        {
+            out.writeInt((int) buffer.size());
+            out.writeInt(bufferIndex);
+            out.writeFloat(last);
+            out.write(buffer.data(), buffer.size() * sizeof (float));
+        }
+
+        bool restoreState(juce::InputStream& in)
+        {
+            if (in.readInt() != (int) buffer.size())
+                return false;
+
+            bufferIndex = in.readInt();
+            last = in.readFloat();
+
+            const int bytes = (int) (buffer.size() * sizeof (float));
+            return juce::isPositiveAndBelow(bufferIndex, (int) buffer.size()) && in.read(buffer.data(), bytes) == bytes;
+        }
+
+        void advance() noexcept
+        {
+            bufferIndex = (bufferIndex + 1 >= (int) buffer.size()) ? 0 : bufferIndex + 1;
+        }
+
+        std::vector<float> buffer;
+        int bufferIndex = 0;
+        float last = 0.0f;
+    };
+
+    struct CombFilter : Line
+    {
+        float process(const float input, const float damp, const float feedbackLevel) noexcept
+        {
+            const float output = buffer[(size_t) bufferIndex];
+            last = (output * (1.0f - damp)) + (last * damp);
+            JUCE_UNDENORMALISE (last);
+
+            float temp = input + (last * feedbackLevel);
+            JUCE_UNDENORMALISE (temp);
+            buffer[(size_t) bufferIndex] = temp;
+            advance();
+            return output;
+        }
+    };
+
+    struct AllPassFilter : Line
+    {
+        float process(const float input) noexcept
+        {
+            const float bufferedValue = buffer[(size_t) bufferIndex];
+            float temp = input + (bufferedValue * 0.5f);
+            JUCE_UNDENORMALISE (temp);
+            buffer[(size_t) bufferIndex] = temp;
+            advance();
+            return bufferedValue - input;
+        }
+    };
+
+    enum { numCombs = 8, numAllPasses = 4, numChannels = 2 };
+
+    Parameters parameters;
+    float gain = 0.015f;
+
+    CombFilter comb[numChannels][numCombs];
+    AllPassFilter allPass[numChannels][numAllPasses];
+
+    Ramp damping, feedback, dryGain, wetGain1, wetGain2;
+};
@@ -0,0 +1,205 @@
+/*
+  ==============================================================================
+
+    InputCrusher.h
+    Created: 19 Oct 2026 12:18:44am
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Basic Oscillator Class.h"
+#include "PitchTables.h"
+#include "TransportLFO.h"
+
+/**
+ * The voices' crush and rate division, applied to the plugin's stereo input for effect mode. It reads
+ * the same bitDepth, LFO and rateDivide parameters, so a preset sounds alike on the synth and on a
+ * drum bus or vocal.
+ *
+ * Both channels go through each loop together. With the LFO amount at zero the depth is constant for
+ * the block and the crush is a multiply, round and multiply the compiler vectorises; depths of 24 bits
+ * and over are left out altogether. The rate division holds one sample per group of rateDivide, with
+ * the count carried across blocks so the groups don't restart at every block boundary.
+ */
+class InputCrusher
+{
+public:
+    /** Samples of LFO rendered at a time, kept on the stack. */
+    static constexpr int maxChunk = 256;
+
+    void setParametersFromAPVTS(juce::AudioProcessorValueTreeState& apvts)
+    {
+        bitDepth = apvts.getRawParameterValue("bitDepth");
+        bitDepthLFOAmount = apvts.getRawParameterValue("bitDepthLFOAmount");
+        LFORate = apvts.getRawParameterValue("LFORate");
+        typeLFO = apvts.getRawParameterValue("typeLFO");
+        lfoSync = apvts.getRawParameterValue("lfoSync");
+        rateDivide = apvts.getRawParameterValue("rateDivide");
+    }
+
+    /**
+     * Sets the LFOs up for a sample rate and restarts the rate division. Called from prepareToPlay.
+     * @param sampleRate The audio sample rate.
+     */
+    void prepare(double sampleRate)
+    {
+        sinLFO.setSampleRate((float) sampleRate);
+        triLFO.setSampleRate((float) sampleRate);
+        squareLFO.setSampleRate((float) sampleRate);
+        squareLFO.setPulseWidth(0.5f);
+
+        holdCount = 0;
+        heldLeft = heldRight = 0.0f;
+    }
+
+    /**
+     * Crushes and decimates a stereo block in place.
+     * @param left Left channel.
+     * @param right Right channel.
+     * @param numSamples Length of the block.
+     * @param transport The host's position at the start of the block, for a synced LFO.
+     */
+    void process(float* left, float* right, int numSamples, const TransportPosition& transport)
+    {
+        const double beatsPerCycle = TransportLFO::getBeatsPerCycle((int) lfoSync->load());
+        const float depth = bitDepth->load();
+        const float amount = bitDepthLFOAmount->load();
+        const int divide = juce::jmax(1, (int) rateDivide->load());
+
+        for (int start = 0; start < numSamples; start += maxChunk)
+        {
+            const int n = juce::jmin(maxChunk, numSamples - start);
+            float* l = left + start;
+            float* r = right + start;
+
+            if (amount == 0.0f)
+            {
+                if (beatsPerCycle <= 0.0)
+                    skipLFO(n); // keeps its phase running, as the voices' LFOs do
+
+                if (depth < 24.0f)
+                    crush(l, r, n, std::exp2(juce::jmax(1.0f, depth)) - 1.0f);
+            }
+            else
+            {
+                float scale[maxChunk];
+
+                if (beatsPerCycle > 0.0)
+                    transportLFO.render((int) typeLFO->load(), transport, beatsPerCycle, start, scale, n);
+                else
+                    renderLFO(scale, n);
+
+                for (int i = 0; i < n; ++i)
+                    scale[i] = FastExp2::exp2(juce::jlimit(1.0f, 24.0f, depth + scale[i] * amount)) - 1.0f;
+
+                for (int i = 0; i < n; ++i)
+                {
+                    l[i] = std::floor(l[i] * scale[i] + 0.5f) / scale[i];
+                    r[i] = std::floor(r[i] * scale[i] + 0.5f) / scale[i];
+                }
+            }
+
+            if (divide > 1)
+                hold(l, r, n, divide);
+        }
+    }
+
+    /** Writes the LFO phases and the rate division's hold, for an engine checkpoint. */
+    void saveState(juce::OutputStream& out) const
+    {
+        out.writeInt((int) sinLFO.getPhaseBits());
+        out.writeInt((int) triLFO.getPhaseBits());
+        out.writeInt((int) squareLFO.getPhaseBits());
+        out.writeInt(holdCount);
+        out.writeFloat(heldLeft);
+        out.writeFloat(heldRight);
+    }
+
+    void restoreState(juce::InputStream& in)
+    {
+        sinLFO.setPhaseBits((uint32_t) in.readInt());
+        triLFO.setPhaseBits((uint32_t) in.readInt());
+        squareLFO.setPhaseBits((uint32_t) in.readInt());
+        holdCount = in.readInt();
+        heldLeft = in.readFloat();
+        heldRight = in.readFloat();
+    }
+
+private:
+    /** Quantises both channels to a fixed number of levels. */
+    static void crush(float* l, float* r, int n, float levels)
+    {
+        const float step = 1.0f / levels;
+
+        for (int i = 0; i < n; ++i)
+        {
+            l[i] = std::floor(l[i] * levels + 0.5f) * step;
+            r[i] = std::floor(r[i] * levels + 0.5f) * step;
+        }
+    }
+
+    /** Holds the first sample of every group of divide samples, continuing the group from the last block. */
+    void hold(float* l, float* r, int n, int divide)
+    {
+        int count = holdCount < divide ? holdCount : 0;
+
+        for (int i = 0; i < n; ++i)
+        {
+            if (count == 0)
+            {
+                heldLeft = l[i];
+                heldRight = r[i];
+            }
+
+            l[i] = heldLeft;
+            r[i] = heldRight;
+
+            if (++count == divide)
+                count = 0;
+        }
+
+        holdCount = count;
+    }
+
+    /** Same shapes and order as the voices' LFO switch. */
+    void renderLFO(float* out, int n)
+    {
+        switch ((int) typeLFO->load())
+        {
+            case 0:  sinLFO.setFrequency(*LFORate);    sinLFO.processBlock(out, n);    break;
+            case 1:  triLFO.setFrequency(*LFORate);    triLFO.processBlock(out, n);    break;
+            case 2:  squareLFO.setFrequency(*LFORate); squareLFO.processBlock(out, n); break;
+            default: juce::FloatVectorOperations::clear(out, n); break;
+        }
+    }
+
+    void skipLFO(int n)
+    {
+        switch ((int) typeLFO->load())
+        {
+            case 0:  sinLFO.setFrequency(*LFORate);    sinLFO.skip(n);    break;
+            case 1:  triLFO.setFrequency(*LFORate);    triLFO.skip(n);    break;
+            case 2:  squareLFO.setFrequency(*LFORate); squareLFO.skip(n); break;
+            default: break;
+        }
+    }
+
+    SinOsc sinLFO;
+    TriLFO triLFO;
+    SquareOsc squareLFO;
+    TransportLFO transportLFO;
+
+    int holdCount = 0;
+    float heldLeft = 0.0f, heldRight = 0.0f;
+
+    std::atomic<float>* bitDepth = nullptr;
+    std::atomic<float>* bitDepthLFOAmount = nullptr;
+    std::atomic<float>* LFORate = nullptr;
+    std::atomic<float>* typeLFO = nullptr;
+    std::atomic<float>* lfoSync = nullptr;
+    std::atomic<float>* rateDivide = nullptr;
+};
@@ -0,0 +1,105 @@
+/*
+  ==============================================================================
+
+    LoadGovernor.h
+    Created: 18 Oct 2026 11:20:37pm
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * Keeps processBlock inside a share of the real-time budget by trading quality for time. Each block's
+ * cost is measured against the time its samples represent at the rate given to prepare(), and when it
+ * passes the budget the governor steps up one degradation level; each level keeps the ones below it:
+ *
+ *  1. a hat or snare hit while still ringing is hit again on its own voice, with no second voice
+ *     rendering the old hit's tail; the noise and its filter carry on through the new hit
+ *  2. the reverb runs in mono, except in effect mode, where the input can be stereo
+ *  3. the synth's voices are limited, releasing voices stolen first
+ *
+ * A level only goes up once the previous one has had a moment to take effect, and only comes down
+ * after the load has stayed well under the budget for a couple of seconds, so it doesn't flap between
+ * levels. Offline renders have no deadline and are never degraded.
+ */
+class LoadGovernor
+{
+public:
+    enum Level { fullQuality, noDrumRetriggers, monoReverb, limitedVoices, numLevels };
+
+    /**
+     * Sets the timing up for a new rate and block size and goes back to full quality. Called from prepareToPlay.
+     * @param sampleRate The audio sample rate.
+     * @param samplesPerBlock The block size the host expects to use.
+     */
+    void prepare(double sampleRate, int samplesPerBlock)
+    {
+        secondsPerSample = sampleRate > 0.0 ? 1.0 / sampleRate : 0.0;
+
+        const double blocksPerSecond = sampleRate / juce::jmax(1, samplesPerBlock);
+        settleBlocks = juce::jmax(1, (int) (settleSeconds * blocksPerSecond));
+        recoverBlocks = juce::jmax(1, (int) (recoverSeconds * blocksPerSecond));
+
+        reset();
+    }
+
+    /** Returns to full quality, e.g. when rendering goes offline. */
+    void reset()
+    {
+        blocksSinceChange = 0;
+        blocksUnderBudget = 0;
+        level.store(fullQuality, std::memory_order_relaxed);
+    }
+
+    /**
+     * Accounts for one processed block and moves the level if needed.
+     * @param seconds Time processBlock took.
+     * @param numSamples Length of the block.
+     * @param budget Share of the real-time budget the block may use, e.g. 0.75.
+     * @return The block's load, its cost as a fraction of the time it represents.
+     */
+    float update(double seconds, int numSamples, float budget)
+    {
+        const double blockSeconds = numSamples * secondsPerSample;
+        const float load = blockSeconds > 0.0 ? (float) (seconds / blockSeconds) : 0.0f;
+        int current = level.load(std::memory_order_relaxed);
+
+        ++blocksSinceChange;
+        blocksUnderBudget = load < budget * recoverRatio ? blocksUnderBudget + 1 : 0;
+
+        if (load > budget && current < numLevels - 1 && blocksSinceChange >= settleBlocks)
+            setLevel(current + 1);
+        else if (current > fullQuality && blocksUnderBudget >= recoverBlocks)
+            setLevel(current - 1);
+
+        return load;
+    }
+
+    /** The current Level; safe to read from any thread. */
+    int getLevel() const { return level.load(std::memory_order_relaxed); }
+
+private:
+    void setLevel(int newLevel)
+    {
+        level.store(newLevel, std::memory_order_relaxed);
+        blocksSinceChange = 0;
+        blocksUnderBudget = 0;
+    }
+
+    // time a new level gets to bring the load down before the next one is tried
+    static constexpr double settleSeconds = 0.1;
+
+    // how long the load must stay under recoverRatio of the budget to step back up in quality
+    static constexpr double recoverSeconds = 2.0;
+    static constexpr float recoverRatio = 0.6f;
+
+    double secondsPerSample = 0.0;
+    int settleBlocks = 1, recoverBlocks = 1;
+    int blocksSinceChange = 0, blocksUnderBudget = 0;
+
+    std::atomic<int> level { fullQuality };
+};
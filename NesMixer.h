@@ -0,0 +1,179 @@
+/*
+  ==============================================================================
+
+    NesMixer.h
+    Created: 18 Oct 2026 7:05:31pm
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+#include <cmath>
+
+/**
+ * The 2A03's output stage. The pulse channels and the triangle/noise channels each go through their
+ * own nonlinear DAC,
+ *
+ *     pulse = 95.52 / (8128 / (p1 + p2) + 100)
+ *     tnd   = 163.67 / (24329 / (3t + 2n) + 100)
+ *
+ * so loud combinations compress, and the sum then passes the console's first-order high-pass at 90 Hz,
+ * high-pass at 440 Hz and low-pass at 14 kHz. Expansion chips (VRC6, N163) come in through the
+ * cartridge's audio input, so their bus is added linearly after the DACs, before the filters.
+ *
+ * Both DAC curves are precomputed into lookup tables. Voices render bipolar, so each bus is applied
+ * symmetrically about zero. A bus value of 1 stands for the DAC's full-scale input (both pulses, or
+ * triangle and noise, at volume 15), and the tables extend well past that so polyphony keeps
+ * compressing instead of clipping. Both curves are normalised to unity gain for quiet signals, so a
+ * single quiet voice comes out at the level it was rendered at.
+ */
+class NesMixer
+{
+public:
+    enum Bus { pulseBus, tndBus, expansionBus, numBuses };
+
+    /** Largest bus value the tables cover; beyond it the output holds at the last entry. */
+    static constexpr float maxBusLevel = 16.0f;
+    static constexpr int tableSize = 4096;
+
+    NesMixer()
+    {
+        // full-scale DAC inputs: 15 + 15 for the pulses, 3 * 15 + 2 * 15 for triangle and noise
+        fillTable(pulseTable, 8128.0, 30.0);
+        fillTable(tndTable, 24329.0, 75.0);
+        prepare(44100.0);
+    }
+
+    /**
+     * Sets the output filters up for a sample rate and clears their state.
+     * @param sampleRate The audio sample rate.
+     */
+    void prepare(double sampleRate)
+    {
+        const double dt = 1.0 / sampleRate;
+        highPass90.coefficient = highPassCoefficient(90.0, dt);
+        highPass440.coefficient = highPassCoefficient(440.0, dt);
+        lowPass14k.coefficient = (float) (dt / (timeConstant(14000.0) + dt));
+        reset();
+    }
+
+    void reset()
+    {
+        highPass90.reset();
+        highPass440.reset();
+        lowPass14k.reset();
+    }
+
+    /** Writes the output filters' state, for an engine checkpoint. */
+    void saveState(juce::OutputStream& out) const
+    {
+        for (auto* highPass : { &highPass90, &highPass440 })
+        {
+            out.writeFloat(highPass->previousIn);
+            out.writeFloat(highPass->previousOut);
+        }
+
+        out.writeFloat(lowPass14k.state);
+    }
+
+    void restoreState(juce::InputStream& in)
+    {
+        for (auto* highPass : { &highPass90, &highPass440 })
+        {
+            highPass->previousIn = in.readFloat();
+            highPass->previousOut = in.readFloat();
+        }
+
+        lowPass14k.state = in.readFloat();
+    }
+
+    /**
+     * Mixes the buses into one mono signal.
+     * @param pulse Sum of the pulse voices.
+     * @param tnd Sum of the triangle and noise voices.
+     * @param expansion Sum of the expansion chip voices.
+     * @param out Destination, overwritten. May be the same as any input.
+     * @param numSamples Number of samples.
+     */
+    void process(const float* pulse, const float* tnd, const float* expansion, float* out, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const float mixed = lookup(pulseTable, pulse[i]) + lookup(tndTable, tnd[i]) + expansion[i];
+            out[i] = lowPass14k.process(highPass440.process(highPass90.process(mixed)));
+        }
+    }
+
+private:
+    using Table = std::array<float, tableSize + 2>;
+
+    /**
+     * @param numerator The constant over the DAC input in the hardware formula (8128 or 24329).
+     * @param fullScale DAC input that a bus value of 1 stands for.
+     */
+    static void fillTable(Table& table, double numerator, double fullScale)
+    {
+        for (int i = 0; i < (int) table.size(); ++i)
+        {
+            // x * numerator / (numerator + 100x) is the DAC curve scaled to unity gain at zero
+            const double x = (double) i / tableSize * maxBusLevel * fullScale;
+            table[(size_t) i] = (float) (x * numerator / (numerator + 100.0 * x) / fullScale);
+        }
+    }
+
+    static float lookup(const Table& table, float value)
+    {
+        const float position = std::fmin(std::fabs(value) * (tableSize / maxBusLevel), (float) tableSize);
+        const int index = (int) position;
+        const float fraction = position - (float) index;
+        const float magnitude = table[(size_t) index] + (table[(size_t) index + 1] - table[(size_t) index]) * fraction;
+
+        return std::copysign(magnitude, value);
+    }
+
+    static double timeConstant(double cutoff)
+    {
+        return 1.0 / (2.0 * 3.14159265358979 * cutoff);
+    }
+
+    static float highPassCoefficient(double cutoff, double dt)
+    {
+        const double rc = timeConstant(cutoff);
+        return (float) (rc / (rc + dt));
+    }
+
+    struct HighPass
+    {
+        float process(float in)
+        {
+            previousOut = coefficient * (previousOut + in - previousIn);
+            previousIn = in;
+            return previousOut;
+        }
+
+        void reset() { previousIn = previousOut = 0.0f; }
+
+        float coefficient = 1.0f, previousIn = 0.0f, previousOut = 0.0f;
+    };
+
+    struct LowPass
+    {
+        float process(float in)
+        {
+            state += coefficient * (in - state);
+            return state;
+        }
+
+        void reset() { state = 0.0f; }
+
+        float coefficient = 1.0f, state = 0.0f;
+    };
+
+    Table pulseTable {}, tndTable {};
+    HighPass highPass90, highPass440;
+    LowPass lowPass14k;
+};
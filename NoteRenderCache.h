@@ -0,0 +1,330 @@
+/*
+  ==============================================================================
+
+    NoteRenderCache.h
+    Created: 18 Oct 2026 10:47:15pm
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * Remembers the rendered start of recently played notes, so an identical note can be copied out
+ * instead of rendered again. A voice that finds no entry for its note records one while it renders;
+ * a voice that finds one plays it back and carries on live where the entry ends.
+ *
+ * Storage is one arena allocated in prepare(), cut into fixed-size chunks that entries chain together,
+ * so recording and eviction never allocate. When the arena or the entry table is full, the least
+ * recently used entry that no voice is reading or recording is evicted.
+ *
+ * Only used from the audio thread; the statistics are atomics so the editor can read them.
+ */
+class NoteRenderCache
+{
+public:
+    static constexpr int chunkSize = 4096;
+    static constexpr int maxEntries = 128;
+
+    /** Builds a key, FNV-1a over every value that affects the cached audio. */
+    struct Key
+    {
+        Key& add(float value)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof (bits));
+            return add(bits);
+        }
+
+        Key& add(uint32_t value)
+        {
+            for (int i = 0; i < 4; ++i)
+                hash = (hash ^ ((value >> (i * 8)) & 0xff)) * 0x100000001b3ull;
+            return *this;
+        }
+
+        Key& add(int value) { return add((uint32_t) value); }
+
+        uint64_t hash = 0xcbf29ce484222325ull;
+    };
+
+    /**
+     * Allocates the arena and empties the cache. Not for the audio thread.
+     * @param maxSamples Total samples all entries together may hold.
+     */
+    void prepare(int maxSamples)
+    {
+        const int numChunks = std::max(1, maxSamples / chunkSize);
+        arena.assign((size_t) numChunks * chunkSize, 0.0f);
+        nextChunk.assign((size_t) numChunks, -1);
+        clear();
+    }
+
+    /** Drops every entry, e.g. when the sample rate changes. */
+    void clear()
+    {
+        for (auto& entry : entries)
+            entry = {};
+
+        freeChunk = -1;
+        for (int chunk = (int) nextChunk.size() - 1; chunk >= 0; --chunk)
+        {
+            nextChunk[(size_t) chunk] = freeChunk;
+            freeChunk = chunk;
+        }
+
+        chunksInUse.store(0, std::memory_order_relaxed);
+    }
+
+    //==============================================================================
+    /**
+     * Looks a note up and, if found, holds the entry for reading until release().
+     * @return The entry, or -1 on a miss.
+     */
+    int acquire(uint64_t key)
+    {
+        for (int i = 0; i < maxEntries; ++i)
+        {
+            auto& entry = entries[(size_t) i];
+
+            if (entry.state == State::ready && entry.key == key)
+            {
+                ++entry.users;
+                entry.lastUsed = ++useClock;
+                hits.fetch_add(1, std::memory_order_relaxed);
+                return i;
+            }
+        }
+
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return -1;
+    }
+
+    /**
+     * Copies cached audio out of an entry.
+     * @return Samples copied, fewer than asked for once the entry runs out.
+     */
+    int read(int entryIndex, int position, float* dest, int numSamples) const
+    {
+        const auto& entry = entries[(size_t) entryIndex];
+        const int available = std::max(0, std::min(numSamples, entry.length - position));
+
+        int chunk = entry.firstChunk;
+        for (int skip = position / chunkSize; skip > 0; --skip)
+            chunk = nextChunk[(size_t) chunk];
+
+        int offset = position % chunkSize;
+        for (int copied = 0; copied < available;)
+        {
+            const int count = std::min(available - copied, chunkSize - offset);
+            std::memcpy(dest + copied, &arena[(size_t) chunk * chunkSize + (size_t) offset], (size_t) count * sizeof (float));
+            copied += count;
+            chunk = nextChunk[(size_t) chunk];
+            offset = 0;
+        }
+
+        return available;
+    }
+
+    /** Lets go of an entry taken with acquire() or beginRecording(). */
+    void release(int entryIndex)
+    {
+        auto& entry = entries[(size_t) entryIndex];
+
+        if (entry.users > 0)
+            --entry.users;
+    }
+
+    //==============================================================================
+    /**
+     * Starts recording a note that missed.
+     * @return The entry to append to, or -1 if every entry is in use.
+     */
+    int beginRecording(uint64_t key)
+    {
+        const int index = findSlot();
+
+        if (index >= 0)
+        {
+            auto& entry = entries[(size_t) index];
+            entry = {};
+            entry.key = key;
+            entry.state = State::recording;
+            entry.users = 1;
+            entry.lastUsed = ++useClock;
+        }
+
+        return index;
+    }
+
+    /**
+     * Adds rendered samples to a recording.
+     * @return False if the arena is full of entries in use; the recording keeps what it has.
+     */
+    bool append(int entryIndex, const float* samples, int numSamples)
+    {
+        auto& entry = entries[(size_t) entryIndex];
+
+        while (numSamples > 0)
+        {
+            const int offset = entry.length % chunkSize;
+
+            if (offset == 0 && ! addChunk(entryIndex))
+                return false;
+
+            const int count = std::min(numSamples, chunkSize - offset);
+            std::memcpy(&arena[(size_t) entry.lastChunk * chunkSize + (size_t) offset], samples, (size_t) count * sizeof (float));
+
+            entry.length += count;
+            samples += count;
+            numSamples -= count;
+        }
+
+        return true;
+    }
+
+    /** Finishes a recording, making it available to later notes, and lets go of it. */
+    void endRecording(int entryIndex)
+    {
+        auto& entry = entries[(size_t) entryIndex];
+        entry.users = 0;
+
+        if (entry.length == 0)
+        {
+            freeEntry(entry);
+            return;
+        }
+
+        // two voices may have recorded the same note; keep the longer take
+        for (auto& other : entries)
+        {
+            if (&other == &entry || other.state != State::ready || other.key != entry.key)
+                continue;
+
+            if (other.length >= entry.length)
+            {
+                freeEntry(entry);
+                return;
+            }
+
+            if (other.users == 0)
+                freeEntry(other);
+        }
+
+        entry.state = State::ready;
+    }
+
+    //==============================================================================
+    uint64_t getHits() const   { return hits.load(std::memory_order_relaxed); }
+    uint64_t getMisses() const { return misses.load(std::memory_order_relaxed); }
+
+    /** Bytes of the arena held by entries. */
+    size_t getBytesInUse() const
+    {
+        return (size_t) chunksInUse.load(std::memory_order_relaxed) * chunkSize * sizeof (float);
+    }
+
+private:
+    enum class State { empty, recording, ready };
+
+    struct Entry
+    {
+        uint64_t key = 0;
+        uint64_t lastUsed = 0;
+        State state = State::empty;
+        int users = 0;
+        int length = 0;
+        int firstChunk = -1, lastChunk = -1;
+    };
+
+    /** An empty entry, or else the least recently used one nobody holds. */
+    int findSlot()
+    {
+        int oldest = -1;
+
+        for (int i = 0; i < maxEntries; ++i)
+        {
+            const auto& entry = entries[(size_t) i];
+
+            if (entry.state == State::empty)
+                return i;
+
+            if (entry.users == 0 && (oldest < 0 || entry.lastUsed < entries[(size_t) oldest].lastUsed))
+                oldest = i;
+        }
+
+        if (oldest >= 0)
+            freeEntry(entries[(size_t) oldest]);
+
+        return oldest;
+    }
+
+    bool addChunk(int entryIndex)
+    {
+        // make room by evicting, oldest first, entries nobody is using
+        while (freeChunk < 0)
+        {
+            int oldest = -1;
+
+            for (int i = 0; i < maxEntries; ++i)
+            {
+                const auto& entry = entries[(size_t) i];
+
+                if (i != entryIndex && entry.state == State::ready && entry.users == 0
+                    && (oldest < 0 || entry.lastUsed < entries[(size_t) oldest].lastUsed))
+                    oldest = i;
+            }
+
+            if (oldest < 0)
+                return false;
+
+            freeEntry(entries[(size_t) oldest]);
+        }
+
+        const int chunk = freeChunk;
+        freeChunk = nextChunk[(size_t) chunk];
+        nextChunk[(size_t) chunk] = -1;
+
+        auto& entry = entries[(size_t) entryIndex];
+        if (entry.lastChunk >= 0)
+            nextChunk[(size_t) entry.lastChunk] = chunk;
+        else
+            entry.firstChunk = chunk;
+
+        entry.lastChunk = chunk;
+        chunksInUse.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void freeEntry(Entry& entry)
+    {
+        for (int chunk = entry.firstChunk; chunk >= 0;)
+        {
+            const int next = nextChunk[(size_t) chunk];
+            nextChunk[(size_t) chunk] = freeChunk;
+            freeChunk = chunk;
+            chunk = next;
+            chunksInUse.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        entry = {};
+    }
+
+    std::vector<float> arena;
+    std::vector<int> nextChunk;
+    int freeChunk = -1;
+
+    std::array<Entry, maxEntries> entries {};
+    uint64_t useClock = 0;
+
+    std::atomic<uint64_t> hits { 0 }, misses { 0 };
+    std::atomic<int> chunksInUse { 0 };
+};
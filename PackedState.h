@@ -0,0 +1,173 @@
+/*
+  ==============================================================================
+
+    PackedState.h
+    Created: 18 Oct 2026 10:12:04am
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * Compact binary form of the plugin state, used by getStateInformation and setStateInformation.
+ * Hosts call these constantly (autosave, undo snapshots, freezing), so instead of building and
+ * parsing an XML ValueTree the state is written as a fixed header followed by the parameter values
+ * packed as floats in the order of parameterIds:
+ *
+ *     uint32 magic | uint32 schema version | uint32 parameter count | float values[count]
+ *
+ * All fields are little-endian. parameterIds is append-only: new parameters go on the end so older
+ * blobs (which carry a smaller count) still restore, and the schema version is only bumped if the
+ * meaning of an existing slot changes.
+ */
+class PackedState
+{
+public:
+    static constexpr juce::uint32 magic = 0x5353454e; // "NESS"
+    static constexpr juce::uint32 schemaVersion = 1;
+    static constexpr int headerSize = 3 * (int) sizeof (juce::uint32);
+
+    /** Fixed slot order of the packed parameter array. Only ever append to this list. */
+    static constexpr const char* parameterIds[] =
+    {
+        "mode", "attack", "decay", "sustain", "release", "pulseWidth1", "pulseWidth2", "pitchOffset",
+        "arpEnabled", "arpRate", "rateDivide", "bitDepth", "typeLFO", "bitDepthLFOAmount", "LFORate",
+        "reverbToggle", "reverbDry", "reverbWet", "reverbRoomSize",
+        "sweepEnabled", "sweepPeriod", "sweepShift", "sweepNegate",
+        "bendRange", "mpeEnabled", "mpeBendRange",
+        "vrc6Duty", "n163Wave", "n163Multiplex", "renderCache",
+        "cpuBudget", "inputEffect", "inputSynthMix", "presetFade",
+        "lfoSync"
+    };
+    static constexpr int numParameters = (int) (sizeof (parameterIds) / sizeof (parameterIds[0]));
+
+    /**
+     * Looks up and caches the parameter objects for every slot, so that saving and restoring never
+     * has to search the parameter tree by name.
+     * @param apvts The processor's parameter tree.
+     */
+    explicit PackedState(juce::AudioProcessorValueTreeState& apvts)
+    {
+        for (int i = 0; i < numParameters; ++i)
+        {
+            parameters[i] = apvts.getParameter(parameterIds[i]);
+            jassert(parameters[i] != nullptr); // every slot must name a parameter in the layout
+        }
+    }
+
+    /**
+     * Checks whether a block of memory starts with the packed state header.
+     * @param data The state blob handed over by the host.
+     * @param sizeInBytes Size of the blob.
+     * @return True if the blob is in the packed format, false if it should be treated as legacy XML.
+     */
+    static bool isPackedState(const void* data, int sizeInBytes)
+    {
+        return data != nullptr && sizeInBytes >= headerSize && readUint32(data, 0) == magic;
+    }
+
+    /**
+     * Writes the current parameter values into a memory block.
+     * @param destData Block to fill; it is resized to exactly the packed size.
+     */
+    void save(juce::MemoryBlock& destData) const
+    {
+        destData.setSize((size_t) (headerSize + numParameters * (int) sizeof (float)), false);
+        auto* dest = static_cast<char*>(destData.getData());
+
+        writeUint32(dest, 0, magic);
+        writeUint32(dest, 4, schemaVersion);
+        writeUint32(dest, 8, (juce::uint32) numParameters);
+
+        for (int i = 0; i < numParameters; ++i)
+        {
+            const float value = parameters[i]->convertFrom0to1(parameters[i]->getValue());
+            juce::uint32 bits;
+            std::memcpy(&bits, &value, sizeof (bits));
+            writeUint32(dest, headerSize + i * (int) sizeof (float), bits);
+        }
+    }
+
+    /**
+     * Reads the packed values straight out of the blob and applies them to the parameters.
+     * Slots missing from older blobs keep their current value and extra slots from newer blobs are ignored.
+     * @param data The state blob.
+     * @param sizeInBytes Size of the blob.
+     * @return False if the blob is not a packed state this build can read, in which case nothing is changed.
+     */
+    bool restore(const void* data, int sizeInBytes)
+    {
+        std::array<float, numParameters> values;
+        const int count = read(data, sizeInBytes, values);
+
+        for (int i = 0; i < count; ++i)
+            parameters[i]->setValueNotifyingHost(parameters[i]->convertTo0to1(values[(size_t) i]));
+
+        return count >= 0;
+    }
+
+    /**
+     * Reads the values out of a blob without applying them, snapped to what each parameter can hold.
+     * @param data The state blob.
+     * @param sizeInBytes Size of the blob.
+     * @param values Receives the values in parameterIds order.
+     * @return How many leading slots were filled, or -1 if the blob is not a packed state this build can read.
+     */
+    int read(const void* data, int sizeInBytes, std::array<float, numParameters>& values) const
+    {
+        if (! isPackedState(data, sizeInBytes) || readUint32(data, 4) > schemaVersion)
+            return -1;
+
+        const auto storedCount = (int) readUint32(data, 8);
+
+        if (storedCount < 0 || (juce::int64) sizeInBytes < headerSize + (juce::int64) storedCount * (juce::int64) sizeof (float))
+            return -1;
+
+        const int count = juce::jmin(storedCount, numParameters);
+
+        for (int i = 0; i < count; ++i)
+        {
+            const juce::uint32 bits = readUint32(data, headerSize + i * (int) sizeof (float));
+            float value;
+            std::memcpy(&value, &bits, sizeof (value));
+            values[(size_t) i] = parameters[i]->convertFrom0to1(parameters[i]->convertTo0to1(value));
+        }
+
+        return count;
+    }
+
+    /** The parameter object of a slot. */
+    juce::RangedAudioParameter* getParameter(int slot) const { return parameters[(size_t) slot]; }
+
+    /**
+     * @param data A blob accepted by restore.
+     * @param sizeInBytes Size of the blob.
+     * @return How many bytes of it the packed parameters take up; anything after that belongs to the caller.
+     */
+    static int getPackedSize(const void* data, int sizeInBytes)
+    {
+        if (! isPackedState(data, sizeInBytes))
+            return 0;
+
+        const auto size = headerSize + (juce::int64) readUint32(data, 8) * (juce::int64) sizeof (float);
+        return (int) juce::jmin((juce::int64) sizeInBytes, size);
+    }
+
+private:
+    static juce::uint32 readUint32(const void* data, int offset)
+    {
+        return juce::ByteOrder::littleEndianInt(static_cast<const char*>(data) + offset);
+    }
+
+    static void writeUint32(char* dest, int offset, juce::uint32 value)
+    {
+        value = juce::ByteOrder::swapIfBigEndian(value);
+        std::memcpy(dest + offset, &value, sizeof (value));
+    }
+
+    std::array<juce::RangedAudioParameter*, numParameters> parameters {};
+};
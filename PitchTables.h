@@ -0,0 +1,174 @@
+/*
+  ==============================================================================
+
+    PitchTables.h
+    Created: 18 Oct 2026 4:02:44pm
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include "FrameSequencer.h"
+
+/**
+ * Table-driven 2^x for pitch maths on the control path. The fractional part is looked up in a
+ * 256-step table of 2^(k/256) with linear interpolation (well under a hundredth of a cent of error)
+ * and the integer part goes straight into the float's exponent, so there is no pow() or exp() call.
+ */
+class FastExp2
+{
+public:
+    static constexpr int tableSize = 256;
+
+    /**
+     * @param x Exponent, roughly -126 to 127.
+     * @return 2 raised to the power x.
+     */
+    static float exp2(float x)
+    {
+        const float whole = std::floor(x);
+        const float position = (x - whole) * (float) tableSize;
+
+        // x - whole rounds up to exactly 1 for tiny negative x; the last step then lands on table[tableSize]
+        const int index = std::min((int) position, tableSize - 1);
+        const float fraction = position - (float) index;
+
+        const auto& table = getTable();
+        const float mantissa = table[(size_t) index] + (table[(size_t) index + 1] - table[(size_t) index]) * fraction;
+
+        // scale by 2^whole by building the power of two directly in the exponent bits
+        const uint32_t bits = (uint32_t) ((int) whole + 127) << 23;
+        float scale;
+        std::memcpy(&scale, &bits, sizeof (scale));
+
+        return mantissa * scale;
+    }
+
+    /**
+     * Converts a pitch interval to a frequency ratio.
+     * @param semitones Interval in semitones, may be fractional.
+     */
+    static float semitonesToRatio(float semitones)
+    {
+        return exp2(semitones * (1.0f / 12.0f));
+    }
+
+    /** Builds the table up front, so the first lookup on the audio thread doesn't have to. */
+    static void prepare()
+    {
+        getTable();
+    }
+
+private:
+    static const std::array<float, tableSize + 1>& getTable()
+    {
+        static const std::array<float, tableSize + 1> table = []
+        {
+            std::array<float, tableSize + 1> t {};
+            for (int i = 0; i <= tableSize; ++i)
+                t[(size_t) i] = (float) std::pow(2.0, (double) i / tableSize);
+            return t;
+        }();
+
+        return table;
+    }
+};
+
+/**
+ * Note-to-period and period-to-phase-increment tables for the 2A03's 11-bit channel timers. Real NES
+ * pitch is whatever the nearest timer period gives, so notes are slightly out of equal temperament and
+ * the low pulse range is clamped; that detuning is part of the sound. The tables are rebuilt for the
+ * current sample rate in prepareToPlay and shared by every voice, so a note on or a pitch update costs
+ * one period calculation and one lookup.
+ */
+class NesTimerTables
+{
+public:
+    static constexpr int numPeriods = 0x800;
+    static constexpr int maxPeriod = numPeriods - 1;
+    static constexpr double cpuClock = FrameSequencer::cpuClock;
+
+    NesTimerTables()
+    {
+        prepare(44100.0);
+    }
+
+    /**
+     * Rebuilds the tables for a sample rate.
+     * @param sampleRate The audio sample rate.
+     */
+    void prepare(double sampleRate)
+    {
+        // the pulse timer is followed by an 8-step sequencer clocked every other CPU cycle (16 cycles per
+        // step pair), the triangle's by a 32-step sequencer clocked every cycle
+        for (int note = 0; note < 128; ++note)
+        {
+            const double frequency = 440.0 * std::pow(2.0, (note - 69) / 12.0);
+            pulsePeriods[(size_t) note] = clampPeriod(cpuClock / (16.0 * frequency) - 1.0);
+            trianglePeriods[(size_t) note] = clampPeriod(cpuClock / (32.0 * frequency) - 1.0);
+        }
+
+        for (int period = 0; period < numPeriods; ++period)
+        {
+            pulseIncrements[(size_t) period] = toPhaseIncrement(cpuClock / (16.0 * (period + 1)) / sampleRate);
+            triangleIncrements[(size_t) period] = toPhaseIncrement(cpuClock / (32.0 * (period + 1)) / sampleRate);
+        }
+    }
+
+    /** @return The pulse timer period closest to a MIDI note. */
+    int getPulsePeriod(int midiNote) const
+    {
+        return pulsePeriods[(size_t) (midiNote & 127)];
+    }
+
+    /** @return The triangle timer period closest to a MIDI note. */
+    int getTrianglePeriod(int midiNote) const
+    {
+        return trianglePeriods[(size_t) (midiNote & 127)];
+    }
+
+    /** @return Fixed-point oscillator phase increment per sample for a pulse timer period. */
+    uint32_t getPulseIncrement(int period) const
+    {
+        return pulseIncrements[(size_t) (period & maxPeriod)];
+    }
+
+    /** @return Fixed-point oscillator phase increment per sample for a triangle timer period. */
+    uint32_t getTriangleIncrement(int period) const
+    {
+        return triangleIncrements[(size_t) (period & maxPeriod)];
+    }
+
+    /**
+     * Moves a timer period by a frequency ratio, rounding to the nearest period the hardware can play.
+     * @param period Starting timer period.
+     * @param ratio Frequency ratio, above 1 to go up in pitch.
+     */
+    static int transposePeriod(int period, float ratio)
+    {
+        return clampPeriod((double) (period + 1) / ratio - 1.0);
+    }
+
+private:
+    /** Converts cycles per sample to a 32-bit phase increment, as used by Phasor. */
+    static uint32_t toPhaseIncrement(double cyclesPerSample)
+    {
+        const double increment = cyclesPerSample * 4294967296.0 + 0.5;
+        return increment >= 4294967295.0 ? 0xffffffffu : (uint32_t) increment;
+    }
+
+    static int clampPeriod(double period)
+    {
+        return period < 0.0 ? 0 : (period > maxPeriod ? maxPeriod : (int) (period + 0.5));
+    }
+
+    std::array<int, 128> pulsePeriods {}, trianglePeriods {};
+    std::array<uint32_t, numPeriods> pulseIncrements {}, triangleIncrements {};
+};
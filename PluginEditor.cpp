@@ -11,15 +11,37 @@
 
 //==============================================================================
 SynthExampleAudioProcessorEditor::SynthExampleAudioProcessorEditor (SynthExampleAudioProcessor& p)
-    : AudioProcessorEditor (&p), audioProcessor (p)
+    : AudioProcessorEditor (&p), audioProcessor (p), parameterEditor (p),
+      voiceActivity (p.getNumSynthVoices())
 {
+    addAndMakeVisible (parameterEditor);
+    addAndMakeVisible (oscilloscope);
+    addAndMakeVisible (spectrum);
+    addAndMakeVisible (voiceActivity);
+    addAndMakeVisible (statusLabel);
+    addAndMakeVisible (loadSamplesButton);
+    addAndMakeVisible (defaultKitButton);
+
+    loadSamplesButton.onClick = [this] { chooseSamples(); };
+    defaultKitButton.onClick = [this] { audioProcessor.loadSampleKit (SynthExampleAudioProcessor::getDefaultSampleKit()); };
+
+    spectrum.setSampleRate (audioProcessor.getSampleRate());
+
+    // only start feeding the views once they exist, and start from fresh audio
+    auto& feed = audioProcessor.getVisualiserFeed();
+    feed.discard();
+    feed.setActive (true);
+    startTimerHz (frameRate);
+
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
-    setSize (400, 300);
+    setSize (720, 720);
 }
 
 SynthExampleAudioProcessorEditor::~SynthExampleAudioProcessorEditor()
 {
+    stopTimer();
+    audioProcessor.getVisualiserFeed().setActive (false);
 }
 
 //==============================================================================
@@ -27,14 +49,83 @@ void SynthExampleAudioProcessorEditor::paint (juce::Graphics& g)
 {
     // (Our component is opaque, so we must completely fill the background with a solid colour)
     g.fillAll (getLookAndFeel().findColour (juce::ResizableWindow::backgroundColourId));
-
-    g.setColour (juce::Colours::white);
-    g.setFont (15.0f);
-    g.drawFittedText ("Hello World!", getLocalBounds(), juce::Justification::centred, 1);
 }
 
 void SynthExampleAudioProcessorEditor::resized()
 {
-    // This is generally where you'll want to lay out the positions of any
-    // subcomponents in your editor..
+    auto bounds = getLocalBounds();
+
+    auto views = bounds.removeFromTop (200).reduced (4);
+    oscilloscope.setBounds (views.removeFromLeft (views.getWidth() / 2).reduced (2));
+    spectrum.setBounds (views.reduced (2));
+
+    voiceActivity.setBounds (bounds.removeFromTop (24).reduced (6, 2));
+    auto statusRow = bounds.removeFromTop (24).reduced (6, 0);
+    defaultKitButton.setBounds (statusRow.removeFromRight (90).reduced (2, 1));
+    loadSamplesButton.setBounds (statusRow.removeFromRight (110).reduced (2, 1));
+    statusLabel.setBounds (statusRow);
+    parameterEditor.setBounds (bounds);
+}
+
+void SynthExampleAudioProcessorEditor::timerCallback()
+{
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+    auto& feed = audioProcessor.getVisualiserFeed();
+
+    const int numPulled = feed.pull (pulled, VisualiserFeed::capacity);
+    oscilloscope.pushSamples (pulled, numPulled);
+    spectrum.pushSamples (pulled, numPulled);
+
+    oscilloscope.refresh();
+    spectrum.refresh();
+    voiceActivity.setActiveVoices (feed.getActiveVoices());
+
+    uiSeconds += juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks);
+
+    if (++framesSinceStatus == frameRate)
+    {
+        const auto& renderCache = audioProcessor.getRenderCache();
+        const auto lookups = renderCache.getHits() + renderCache.getMisses();
+        const juce::String cacheStatus = lookups == 0 ? juce::String()
+            : "   note cache " + juce::String (100.0 * (double) renderCache.getHits() / (double) lookups, 0) + "% hits, "
+                + juce::String ((int) (renderCache.getBytesInUse() / 1024)) + " KB";
+
+        statusLabel.setText ("Audio load " + juce::String (audioProcessor.getAudioLoad() * 100.0f, 1) + "%"
+                               + "   UI " + juce::String (uiSeconds * 1000.0 / frameRate, 2) + " ms/frame"
+                               + "   dropped blocks " + juce::String ((int) feed.getDroppedBlocks())
+                               + "   stream underruns " + juce::String ((int) audioProcessor.getSampleStreamUnderruns())
+                               + cacheStatus
+                               + (audioProcessor.getDegradationLevel() > 0
+                                    ? "   quality lowered, level " + juce::String (audioProcessor.getDegradationLevel()) : juce::String()),
+                             juce::dontSendNotification);
+        uiSeconds = 0.0;
+        framesSinceStatus = 0;
+    }
+}
+
+void SynthExampleAudioProcessorEditor::chooseSamples()
+{
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+
+    sampleChooser = std::make_unique<juce::FileChooser> ("Choose drum samples", juce::File(), formats.getWildcardForAllFormats());
+    sampleChooser->launchAsync (juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles
+                                  | juce::FileBrowserComponent::canSelectMultipleItems,
+                                [this] (const juce::FileChooser& chooser)
+    {
+        juce::Array<SampleMapping> kit;
+        int note = 53;
+
+        for (const auto& file : chooser.getResults())
+        {
+            if (note > 127)
+                break;
+
+            kit.add ({ file.getFullPathName(), note, note, note });
+            note += 2;
+        }
+
+        if (! kit.isEmpty())
+            audioProcessor.loadSampleKit (kit);
+    });
 }
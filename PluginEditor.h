@@ -10,11 +10,13 @@
 
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
+#include "Visualisers.h"
 
 //==============================================================================
 /**
 */
-class SynthExampleAudioProcessorEditor  : public juce::AudioProcessorEditor
+class SynthExampleAudioProcessorEditor  : public juce::AudioProcessorEditor,
+                                          private juce::Timer
 {
 public:
     SynthExampleAudioProcessorEditor (SynthExampleAudioProcessor&);
@@ -25,9 +27,33 @@ public:
     void resized() override;
 
 private:
+    /** Pulls whatever the audio thread has queued and refreshes the views that changed. */
+    void timerCallback() override;
+
+    /** Lets the user pick drum samples, mapped to every other note from 53 like the built-in kit. */
+    void chooseSamples();
+
     // This reference is provided as a quick way for your editor to
     // access the processor object that created it.
     SynthExampleAudioProcessor& audioProcessor;
 
+    // repaint rate cap, the views only repaint when they have new data
+    static constexpr int frameRate = 30;
+
+    juce::GenericAudioProcessorEditor parameterEditor;
+    OscilloscopeView oscilloscope;
+    SpectrumView spectrum;
+    VoiceActivityView voiceActivity;
+    juce::Label statusLabel;
+    juce::TextButton loadSamplesButton { "Load Samples..." };
+    juce::TextButton defaultKitButton { "Default Kit" };
+    std::unique_ptr<juce::FileChooser> sampleChooser;
+
+    float pulled[VisualiserFeed::capacity] = {};
+
+    // time spent in timerCallback, reported once a second next to the audio load
+    double uiSeconds = 0.0;
+    int framesSinceStatus = 0;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SynthExampleAudioProcessorEditor)
 };
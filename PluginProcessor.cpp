@@ -11,35 +11,93 @@
 #include "Arp.h"
 #include "DrumSampler.h"
 
+#if NES_TRACE_ALLOCATIONS
 //==============================================================================
-SynthExampleAudioProcessor::SynthExampleAudioProcessor()
+// test builds only: route every heap call through the tracer
+void* operator new (std::size_t size)
+{
+    AllocationTracer::heapUsed();
+
+    if (void* p = std::malloc(size > 0 ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size)                { return operator new (size); }
+void operator delete (void* p) noexcept               { AllocationTracer::heapUsed(); std::free (p); }
+void operator delete[] (void* p) noexcept             { operator delete (p); }
+void operator delete (void* p, std::size_t) noexcept   { operator delete (p); }
+void operator delete[] (void* p, std::size_t) noexcept { operator delete (p); }
+#endif
+
+//==============================================================================
+SynthExampleAudioProcessor::SynthExampleAudioProcessor(bool headless)
 : AudioProcessor(BusesProperties().withInput("Input", juce::AudioChannelSet::stereo(), true).withOutput("Output", juce::AudioChannelSet::stereo(), true)),
-  apvts(*this, nullptr, "Parameters", createParameterLayout())
+  apvts(*this, nullptr, "Parameters", createParameterLayout()),
+  presetSwitcher(packedState, apvts, ! headless)
 {
     //add voices to synth
-    synth.addSound(new BitCrusherSound());
+    synth.setParametersFromAPVTS(apvts);
+    synth.addSound(new BitCrusherSound(BitCrusherSound::Channel::melodic));
+    synth.addSound(new BitCrusherSound(BitCrusherSound::Channel::noise));
     for (int i = 0; i < voiceCount; i++) {
-        synth.addVoice(new BitCrusherVoice());
+        synth.addNesVoice(new MelodicVoice());
+    }
+    for (int i = 0; i < drumVoiceCount; i++) {
+        synth.addNesVoice(new NoiseDrumVoice());
     }
 
     // Set up each voice to use the parameters from APVTS
     for (int i = 0; i < synth.getNumVoices(); i++) {
-        if (auto* voice = dynamic_cast<BitCrusherVoice*>(synth.getVoice(i))) {
+        if (auto* voice = dynamic_cast<NesVoice*>(synth.getVoice(i))) {
             voice->setParametersFromAPVTS(apvts);
         }
     }
     
+    // the processBlock controls, looked up here so the audio thread never searches the tree
+    modeParam = apvts.getRawParameterValue("mode");
+    arpEnabledParam = apvts.getRawParameterValue("arpEnabled");
+    arpRateParam = apvts.getRawParameterValue("arpRate");
+    reverbToggleParam = apvts.getRawParameterValue("reverbToggle");
+    reverbDryParam = apvts.getRawParameterValue("reverbDry");
+    reverbWetParam = apvts.getRawParameterValue("reverbWet");
+    reverbRoomSizeParam = apvts.getRawParameterValue("reverbRoomSize");
+    cpuBudgetParam = apvts.getRawParameterValue("cpuBudget");
+    inputEffectParam = apvts.getRawParameterValue("inputEffect");
+    inputSynthMixParam = apvts.getRawParameterValue("inputSynthMix");
+    presetFadeParam = apvts.getRawParameterValue("presetFade");
+    inputCrusher.setParametersFromAPVTS(apvts);
+
+    crushVoice = dynamic_cast<MelodicVoice*>(synth.getVoice(0));
+
     // add voices to sampler
     for (int i =0; i<voiceCount; i++)
     {
-        sampler.addVoice(new juce::SamplerVoice());
+        sampler.addSampleVoice(new SampleVoice());
         
     }
-    //add each sample to a specific note
-    sampler.setSample(BinaryData::Bongo_01_wav, BinaryData::Bongo_01_wavSize, 53, 53);
-    sampler.setSample(BinaryData::clap_wav, BinaryData::clap_wavSize, 55, 55);
-    sampler.setSample(BinaryData::tom_wav, BinaryData::tom_wavSize, 57, 57);
-    sampler.setSample(BinaryData::kick_wav, BinaryData::kick_wavSize, 59, 59);
+    //the built-in drums, loaded in the background like any user kit
+    auto& sampleLoader = sampler.getLoader();
+    sampleLoader.registerBuiltIn("Bongo_01.wav", BinaryData::Bongo_01_wav, BinaryData::Bongo_01_wavSize);
+    sampleLoader.registerBuiltIn("clap.wav", BinaryData::clap_wav, BinaryData::clap_wavSize);
+    sampleLoader.registerBuiltIn("tom.wav", BinaryData::tom_wav, BinaryData::tom_wavSize);
+    sampleLoader.registerBuiltIn("kick.wav", BinaryData::kick_wav, BinaryData::kick_wavSize);
+    loadSampleKit(getDefaultSampleKit());
+
+    // index the preset folder in the background and tell the host when the program list changes
+    presetLibrary.onIndexChanged = [this]
+    {
+        updateHostDisplay(juce::AudioProcessorListener::ChangeDetails().withProgramChanged(true));
+    };
+    presetLibrary.onPresetLoaded = [this](int index, const juce::MemoryBlock& state)
+    {
+        currentProgram = index;
+        restorePackedState(state.getData(), (int) state.getSize());
+        updateHostDisplay(juce::AudioProcessorListener::ChangeDetails().withProgramChanged(true));
+    };
+    if (! headless)
+        presetLibrary.setDirectory(PresetLibrary::getDefaultDirectory());
 }
 
 SynthExampleAudioProcessor::~SynthExampleAudioProcessor()
@@ -86,26 +144,77 @@ double SynthExampleAudioProcessor::getTailLengthSeconds() const
 
 int SynthExampleAudioProcessor::getNumPrograms()
 {
-    return 1;   // NB: some hosts don't cope very well if you tell them there are 0 programs,
-                // so this should be at least 1, even if you're not really implementing programs.
+    // NB: some hosts don't cope very well if you tell them there are 0 programs,
+    // so this should be at least 1, even if the preset folder is empty.
+    return juce::jmax(1, presetLibrary.getNumPresets());
 }
 
 int SynthExampleAudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return currentProgram;
 }
 
 void SynthExampleAudioProcessor::setCurrentProgram (int index)
 {
+    // the host sees the new program straight away; the preset file is read on the library thread and
+    // applied once it arrives on the message thread
+    currentProgram = index;
+    presetLibrary.loadPreset(index);
 }
 
 const juce::String SynthExampleAudioProcessor::getProgramName (int index)
 {
+    auto presets = presetLibrary.getIndex();
+
+    if (juce::isPositiveAndBelow(index, presets->size()))
+        return presets->getReference(index).name;
+
     return {};
 }
 
 void SynthExampleAudioProcessor::changeProgramName (int index, const juce::String& newName)
 {
+    // preset names live in the files, use savePreset to store a renamed copy
+}
+
+bool SynthExampleAudioProcessor::savePreset (const juce::String& name, const juce::String& tags)
+{
+    juce::MemoryBlock state;
+    packedState.save(state);
+
+    auto file = presetLibrary.getDirectory().getChildFile(juce::File::createLegalFileName(name))
+                                            .withFileExtension("nespreset");
+    const int mode = (int) apvts.getRawParameterValue("mode")->load();
+
+    if (! PresetLibrary::savePreset(file, name, tags, mode, state))
+        return false;
+
+    presetLibrary.rescan();
+    return true;
+}
+
+juce::Array<SampleMapping> SynthExampleAudioProcessor::getDefaultSampleKit()
+{
+    juce::Array<SampleMapping> kit;
+
+    auto addBuiltIn = [&kit](const char* name, int note)
+    {
+        kit.add({ juce::String(SampleMapping::builtInPrefix) + name, note, note, note });
+    };
+
+    addBuiltIn("Bongo_01.wav", 53);
+    addBuiltIn("clap.wav", 55);
+    addBuiltIn("tom.wav", 57);
+    addBuiltIn("kick.wav", 59);
+    return kit;
+}
+
+void SynthExampleAudioProcessor::loadSampleKit (const juce::Array<SampleMapping>& kit)
+{
+    juce::MemoryOutputStream out(sampleKitState, false);
+    SampleSetLoader::writeKit(out, kit);
+
+    sampler.getLoader().loadKit(kit);
 }
 
 //==============================================================================
@@ -115,17 +224,35 @@ void SynthExampleAudioProcessor::prepareToPlay (double sampleRate, int samplesPe
     // initialisation that you need..
 
     arpeggiator.prepareToPlay(sampleRate, samplesPerBlock);
+    arpMidi.ensureSize(arpMidiBytes);
+    freeRunningPosition.reset();
+    FastExp2::prepare();
 
-    synth.setCurrentPlaybackSampleRate(sampleRate);
+    synth.prepare(sampleRate, samplesPerBlock);
     sampler.setCurrentPlaybackSampleRate(sampleRate);
+    sampler.getLoader().setTargetSampleRate(sampleRate);
     reverb.reset();
     reverb.setSampleRate(sampleRate);
+    reverb.setParameters(reverbParams);
+    loadGovernor.prepare(sampleRate, samplesPerBlock);
+
+    inputCrusher.prepare(sampleRate);
+    effectBuffer.setSize(2, samplesPerBlock);
+}
+
+void SynthExampleAudioProcessor::setNonRealtime (bool isNonRealtime) noexcept
+{
+    juce::AudioProcessor::setNonRealtime (isNonRealtime);
+
+    // offline renders can wait for disk, so long samples never underrun there
+    sampler.setSynchronousStreaming (isNonRealtime);
 }
 
 void SynthExampleAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    processing = false;
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -156,66 +283,218 @@ bool SynthExampleAudioProcessor::isBusesLayoutSupported (const BusesLayout& layo
 
 void SynthExampleAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    const AllocationTracer::ScopedAudioThread tracedBlock(! isNonRealtime()); // offline renders may read disk
+    const juce::ScopedNoDenormals noDenormals; // decaying filter and reverb tails settle at exactly zero
+    const auto startTicks = juce::Time::getHighResolutionTicks();
+
+    // a preset change lands here, every parameter at once, with the output dipped around it
+    processing.store(true, std::memory_order_relaxed);
+    presetSwitcher.beginBlock((int) (presetFadeParam->load() * 0.001 * getSampleRate()));
+
+    const int numSamples = buffer.getNumSamples();
+
+    // read the transport once for everything that syncs to it
+    transport = TransportPosition::read(getPlayHead(), getSampleRate(), fallbackBPM, freeRunningPosition.getPPQ());
+    freeRunningPosition.advance(transport, numSamples);
+    synth.setTransport(transport);
+
+    // effect mode: crush the input now, it joins the synth after that has rendered
+    const bool inputEffect = inputEffectParam->load() > 0.5f && getTotalNumInputChannels() > 0;
+    if (inputEffect)
+    {
+        // only if the host breaks its promised maximum block size
+        if (effectBuffer.getNumSamples() < numSamples)
+            effectBuffer.setSize(2, numSamples, false, false, true);
+
+        effectBuffer.copyFrom(0, 0, buffer, 0, 0, numSamples);
+        effectBuffer.copyFrom(1, 0, buffer, juce::jmin(1, buffer.getNumChannels() - 1), 0, numSamples);
+        inputCrusher.process(effectBuffer.getWritePointer(0), effectBuffer.getWritePointer(1), numSamples, transport);
+    }
+
     // Clear the audio buffer
     buffer.clear();
 
+    // trade quality for time while over the CPU budget, one step per level
+    const int degradation = loadGovernor.getLevel();
+    synth.setDrumRetriggers(degradation < LoadGovernor::noDrumRetriggers);
+    synth.setVoiceLimit(degradation >= LoadGovernor::limitedVoices ? voiceLimitUnderLoad : 0);
+
     // Set up the arpeggiator parameters
-    arpeggiator.setFallbackBPM(80.0);
     arpeggiator.setPlayHead(getPlayHead());
-    arpeggiator.setRate(*apvts.getRawParameterValue("arpRate"));
+    arpeggiator.setRate((int) arpRateParam->load());
 
-    // Process arpeggiator if enabled
-    if (apvts.getRawParameterValue("arpEnabled")->load() == 0)
+    const juce::MidiBuffer* blockMidi = &midiMessages;
+
+    // Process arpeggiator if enabled. It adds to a reserved copy, the host's buffer may not have room.
+    if (arpEnabledParam->load() == 0)
     {
-        arpeggiator.processBlock(buffer, midiMessages);
+        arpMidi.clear();
+        arpMidi.addEvents(midiMessages, 0, -1, 0);
+        arpeggiator.processBlock(buffer, arpMidi, transport);
+        blockMidi = &arpMidi;
     }
 
-    // Render next block for the synthesizer
-    synth.renderNextBlock(buffer, midiMessages, 0, buffer.getNumSamples());
+    // read the block's MIDI once for both engines; each renders its voices in a single pass
+    blockEvents.fill(*blockMidi, buffer.getNumSamples());
+
+    // Render next block for the synthesizer, mixed down in mono and added to both channels
+    synth.renderBlock(buffer, blockEvents);
     
-    // Process sampler if mode is 2 (sampler mode and white noise) and arpeggiator is off
-    if (apvts.getRawParameterValue("mode")->load() == 2)
+    // Process sampler if mode is 2 (sampler mode and white noise) and arpeggiator is off.
+    // The samples are not part of the 2A03, so they join after its mixer.
+    if (modeParam->load() == 2)
     {
-        sampler.renderNextBlock(buffer, midiMessages, 0, buffer.getNumSamples());
+        sampler.renderBlock(buffer, blockEvents);
     
         // Apply bit-crushing to buffer
         float* left = buffer.getWritePointer(0);
         float* right = buffer.getWritePointer(1);
+
         for (int sample = 0; sample < buffer.getNumSamples(); ++sample)
         {
             float currentSample = buffer.getSample(0, sample);
             
-            //dynamic cast functions so that we can use it from synth class
-            auto voice = dynamic_cast<BitCrusherVoice*>(synth.getVoice(0));
-            
-            float bitcrushedSample = voice->bitcrushing(currentSample, 0);
+            float bitcrushedSample = crushVoice->bitcrushing(currentSample, 0);
             
             left[sample] = bitcrushedSample;
             right[sample] = bitcrushedSample;
         }
     }
+    else
+    {
+        sampler.skipBlock();
+    }
     
+    if (inputEffect)
+    {
+        buffer.applyGain(inputSynthMixParam->load());
+        buffer.addFrom(0, 0, effectBuffer, 0, 0, numSamples);
+        buffer.addFrom(1, 0, effectBuffer, 1, 0, numSamples);
+    }
+
     // Process reverb if enabled
-    if(apvts.getRawParameterValue("reverbToggle")->load())
+    if(reverbToggleParam->load())
     {
-        // Set up reverb parameters
-        juce::Reverb::Parameters reverbParams;
-        reverbParams.dryLevel = apvts.getRawParameterValue("reverbDry")->load();
-        reverbParams.wetLevel = apvts.getRawParameterValue("reverbWet")->load();
-        reverbParams.roomSize = apvts.getRawParameterValue("reverbRoomSize")->load();
-        reverb.setParameters(reverbParams);
+        // Set up reverb parameters, only when they've moved
+        const float dry = reverbDryParam->load();
+        const float wet = reverbWetParam->load();
+        const float roomSize = reverbRoomSizeParam->load();
+
+        if (dry != reverbParams.dryLevel || wet != reverbParams.wetLevel || roomSize != reverbParams.roomSize)
+        {
+            reverbParams.dryLevel = dry;
+            reverbParams.wetLevel = wet;
+            reverbParams.roomSize = roomSize;
+            reverb.setParameters(reverbParams);
+        }
         
-        // Apply reverb to the buffer
+        // Apply reverb to the buffer; the synth is mono, so under load only one side's reverb runs,
+        // unless a stereo input is mixed in by effect mode
         float* left = buffer.getWritePointer(0);
         float* right = buffer.getWritePointer(1);
-        reverb.processStereo(left, right, buffer.getNumSamples());
+
+        if (degradation >= LoadGovernor::monoReverb && ! inputEffect)
+        {
+            reverb.processMono(left, buffer.getNumSamples());
+            juce::FloatVectorOperations::copy(right, left, buffer.getNumSamples());
+        }
+        else
+        {
+            reverb.processStereo(left, right, buffer.getNumSamples());
+        }
+    }
+
+    presetSwitcher.processFade(buffer);
+
+    // feed the editor's views, only while an editor is open
+    if (visualiserFeed.isActive())
+    {
+        visualiserFeed.push(buffer.getReadPointer(0), buffer.getNumSamples());
+
+        juce::uint32 voiceMask = 0;
+        for (int i = 0; i < synth.getNumVoices() && i < 32; ++i)
+            if (synth.getVoice(i)->isVoiceActive())
+                voiceMask |= 1u << i;
+
+        visualiserFeed.setActiveVoices(voiceMask);
     }
 
     // Clear the MIDI messages buffer
     midiMessages.clear();
+
+    // block cost against the time the block represents, smoothed over roughly 20 blocks for display
+    const double seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+    const float load = loadGovernor.update(seconds, buffer.getNumSamples(), cpuBudgetParam->load());
+
+    if (isNonRealtime())
+        loadGovernor.reset();
+
+    audioLoad.store(audioLoad.load(std::memory_order_relaxed) * 0.95f + load * 0.05f, std::memory_order_relaxed);
 }
 
 
+bool SynthExampleAudioProcessor::hasActiveVoices() const
+{
+    return synth.hasSoundingVoices() || sampler.hasSoundingVoices();
+}
+
+void SynthExampleAudioProcessor::saveDspState (juce::MemoryBlock& destData) const
+{
+    const juce::ScopedLock sl (getCallbackLock());
+    juce::MemoryOutputStream out (destData, false);
+
+    // whether it can be restored goes first, so restoring can refuse before changing anything
+    out.writeInt (dspStateMagic);
+    out.writeInt (dspStateVersion);
+    out.writeDouble (getSampleRate());
+    out.writeBool (hasActiveVoices());
+
+    freeRunningPosition.saveState (out);
+    arpeggiator.saveState (out);
+    synth.saveState (out);
+    sampler.saveState (out);
+
+    out.writeFloat (reverbParams.dryLevel);
+    out.writeFloat (reverbParams.wetLevel);
+    out.writeFloat (reverbParams.roomSize);
+    reverb.saveState (out);
+
+    inputCrusher.saveState (out);
+}
+
+bool SynthExampleAudioProcessor::restoreDspState (const void* data, int sizeInBytes)
+{
+    juce::MemoryInputStream in (data, (size_t) sizeInBytes, false);
+
+    if (in.readInt() != dspStateMagic || in.readInt() != dspStateVersion
+         || in.readDouble() != getSampleRate() || in.readBool())
+        return false;
+
+    const juce::ScopedLock sl (getCallbackLock());
+
+    freeRunningPosition.restoreState (in);
+    arpeggiator.restoreState (in);
+
+    if (! synth.restoreState (in) || ! sampler.restoreState (in))
+        return false;
+
+    reverbParams.dryLevel = in.readFloat();
+    reverbParams.wetLevel = in.readFloat();
+    reverbParams.roomSize = in.readFloat();
+    const bool reverbRestored = reverb.restoreState (in);
+
+    inputCrusher.restoreState (in);
+    return reverbRestored;
+}
+
+void SynthExampleAudioProcessor::setRenderPosition (juce::int64 samplePosition)
+{
+    const juce::ScopedLock sl (getCallbackLock());
+
+    synth.setRenderPosition (samplePosition);
+    freeRunningPosition.seek (samplePosition);
+}
+
 //==============================================================================
 bool SynthExampleAudioProcessor::hasEditor() const
 {
@@ -224,7 +503,7 @@ bool SynthExampleAudioProcessor::hasEditor() const
 
 juce::AudioProcessorEditor* SynthExampleAudioProcessor::createEditor()
 {
-    return new juce::GenericAudioProcessorEditor (*this);
+    return new SynthExampleAudioProcessorEditor (*this);
 }
 
 //==============================================================================
@@ -234,10 +513,11 @@ void SynthExampleAudioProcessor::getStateInformation (juce::MemoryBlock& destDat
     // You could do that either as raw data, or use the XML or ValueTree classes
     // as intermediaries to make it easy to save and load complex data.
 
-    // this code goes in getStateInformation()
-    auto state = apvts.copyState();
-    std::unique_ptr<juce::XmlElement> xml(state.createXml());
-    copyXmlToBinary(*xml, destData);
+    // parameters are written as a packed float array rather than XML, see PackedState.h
+    packedState.save(destData);
+
+    // followed by the sample kit, which older builds ignore
+    destData.append(sampleKitState.getData(), sampleKitState.getSize());
 }
 
 void SynthExampleAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
@@ -245,6 +525,20 @@ void SynthExampleAudioProcessor::setStateInformation (const void* data, int size
     // You should use this method to restore your parameters from this memory block,
     // whose contents will have been created by the getStateInformation() call.
 
+    // fast path: packed binary state, read in place with no parsing
+    if (restorePackedState(data, sizeInBytes))
+    {
+        const int packedSize = PackedState::getPackedSize(data, sizeInBytes);
+        juce::MemoryInputStream kitStream(static_cast<const char*>(data) + packedSize, (size_t) (sizeInBytes - packedSize), false);
+
+        juce::Array<SampleMapping> kit;
+        if (SampleSetLoader::readKit(kitStream, kit))
+            loadSampleKit(kit);
+
+        return;
+    }
+
+    // older sessions saved the apvts as XML, so keep reading those
     std::unique_ptr<juce::XmlElement> xmlState(getXmlFromBinary(data, sizeInBytes));
     if (xmlState.get() != nullptr)
     {
@@ -255,6 +549,15 @@ void SynthExampleAudioProcessor::setStateInformation (const void* data, int size
     }
 }
 
+bool SynthExampleAudioProcessor::restorePackedState (const void* data, int sizeInBytes)
+{
+    // offline, or before any block, nothing can hear a parameter at a time changing
+    if (isNonRealtime() || ! processing.load())
+        return packedState.restore(data, sizeInBytes);
+
+    return presetSwitcher.publish(data, sizeInBytes);
+}
+
 //==============================================================================
 // This creates new instances of the plugin..
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
@@ -12,6 +12,14 @@
 #include "Synthesiser Starting code (sound and voice).h"
 #include "DrumSampler.h"
 #include "Arp.h"
+#include "PackedState.h"
+#include "PresetLibrary.h"
+#include "VisualiserFeed.h"
+#include "AllocationTracer.h"
+#include "LoadGovernor.h"
+#include "InputCrusher.h"
+#include "PresetSwitcher.h"
+#include "Freeverb.h"
 
 //==============================================================================
 /**
@@ -20,7 +28,11 @@ class SynthExampleAudioProcessor  : public juce::AudioProcessor
 {
 public:
     //==============================================================================
-    SynthExampleAudioProcessor();
+    /**
+     * @param headless For engines that only render, e.g. offline: the preset folder isn't scanned and
+     *                 no timer tells the host about preset switches, which processBlock applies.
+     */
+    explicit SynthExampleAudioProcessor(bool headless = false);
     ~SynthExampleAudioProcessor() override;
 
     //==============================================================================
@@ -33,6 +45,8 @@ public:
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
 
+    void setNonRealtime (bool isNonRealtime) noexcept override;
+
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
     bool hasEditor() const override;
@@ -56,30 +70,171 @@ public:
     void getStateInformation(juce::MemoryBlock& destData) override;
     void setStateInformation(const void* data, int sizeInBytes) override;
 
+    //==============================================================================
+    /**
+     * Saves the current parameters as a preset file in the library folder and rescans it.
+     * @param name Display name of the preset, also used for the file name.
+     * @param tags Space-separated search tags.
+     * @return True if the preset was written.
+     */
+    bool savePreset(const juce::String& name, const juce::String& tags);
+
+    PresetLibrary& getPresetLibrary() { return presetLibrary; }
+
+    //==============================================================================
+    /**
+     * Replaces the drum sampler's kit. The samples are decoded and swapped in on a background thread;
+     * the kit is saved with the plugin state.
+     * @param kit The samples and the notes they play on.
+     */
+    void loadSampleKit(const juce::Array<SampleMapping>& kit);
+
+    juce::Array<SampleMapping> getSampleKit() const { return sampler.getLoader().getKit(); }
+
+    /** The four built-in drums on notes 53, 55, 57 and 59. */
+    static juce::Array<SampleMapping> getDefaultSampleKit();
+
+    /** The synth's note render cache, for its hit rate and memory use. */
+    const NoteRenderCache& getRenderCache() const { return synth.getRenderCache(); }
+
+    /** Frames of long samples that played as silence because streaming fell behind. */
+    juce::uint32 getSampleStreamUnderruns() const { return sampler.getStreamUnderruns(); }
+
+    //==============================================================================
+    /** Audio and voice activity for the editor's views. */
+    VisualiserFeed& getVisualiserFeed() { return visualiserFeed; }
+
+    /** Smoothed processBlock cost as a fraction of the real-time budget of a block. */
+    float getAudioLoad() const { return audioLoad.load(std::memory_order_relaxed); }
+
+    /** How far quality has been lowered to stay within the CPU budget, a LoadGovernor::Level. */
+    int getDegradationLevel() const { return loadGovernor.getLevel(); }
+
+    int getNumSynthVoices() const { return voiceCount + drumVoiceCount; }
+
+    /** True until every synth and sampler voice has finished its envelope. */
+    bool hasActiveVoices() const;
+
+    /**
+     * Waits for the sample kit and rate requested so far to finish loading, before an offline render.
+     * @param timeoutMs How long to wait at most.
+     * @return False if it wasn't ready in time.
+     */
+    bool waitForSampleKit(int timeoutMs) const { return sampler.getLoader().waitUntilLoaded(timeoutMs); }
+
+    //==============================================================================
+    /**
+     * Saves the engine's DSP state between blocks, for checkpointed offline renders: the sample count
+     * and free-running transport, the arpeggiator, the voices, the NES mixer's filters, the reverb and
+     * the input crusher. Two engines with the same parameters and equal checkpoints render the same
+     * audio from there on. Not while a block is being rendered.
+     * @param destData Block to fill; replaced.
+     */
+    void saveDspState(juce::MemoryBlock& destData) const;
+
+    /**
+     * Restores a checkpoint saved by saveDspState at the same sample rate. Only checkpoints taken with
+     * every voice silent can be restored, since juce::ADSR, the Synthesiser's voice bookkeeping and the
+     * sample streams keep the state of a sounding note to themselves.
+     * @param data A saveDspState blob.
+     * @param sizeInBytes Size of the blob.
+     * @return False, with nothing changed, if the checkpoint can't be restored.
+     */
+    bool restoreDspState(const void* data, int sizeInBytes);
+
+    /**
+     * Moves the engine's own sample count and free-running transport on, as if it had rendered up to
+     * a position. For starting a render part-way through.
+     * @param samplePosition Samples since the start of the render.
+     */
+    void setRenderPosition(juce::int64 samplePosition);
+
 private:
 
     // create objects
-    juce::Reverb reverb;
+    Freeverb reverb;
 
-    juce::Synthesiser synth;
+    NesSynthesiser synth;
 
     Arpeggiator arpeggiator;
     
     Sampler sampler;
+
+    // MIDI of the current block, shared by synth and sampler
+    MidiEventList blockEvents;
+
+    // the host's MIDI plus the arpeggiator's notes; reserved in prepareToPlay so adding to it doesn't allocate
+    juce::MidiBuffer arpMidi;
+    static constexpr size_t arpMidiBytes = 16384;
+
+    // looked up once, processBlock only reads them
+    std::atomic<float>* modeParam = nullptr;
+    std::atomic<float>* arpEnabledParam = nullptr;
+    std::atomic<float>* arpRateParam = nullptr;
+    std::atomic<float>* reverbToggleParam = nullptr;
+    std::atomic<float>* reverbDryParam = nullptr;
+    std::atomic<float>* reverbWetParam = nullptr;
+    std::atomic<float>* reverbRoomSizeParam = nullptr;
+    juce::Reverb::Parameters reverbParams;
+
+    // the block's transport position, and a count of our own for hosts that don't report one
+    TransportPosition transport;
+    FreeRunningPosition freeRunningPosition;
+    static constexpr double fallbackBPM = 80.0;
+
+    static constexpr int dspStateMagic = 0x4453454e; // "NESD"
+    static constexpr int dspStateVersion = 1;
+
+    // effect mode: the input, crushed, waiting to be mixed with the synth; sized in prepareToPlay
+    InputCrusher inputCrusher;
+    juce::AudioBuffer<float> effectBuffer;
+    std::atomic<float>* inputEffectParam = nullptr;
+    std::atomic<float>* inputSynthMixParam = nullptr;
+
+    // the voice whose bit crusher processes the sampler's output
+    MelodicVoice* crushVoice = nullptr;
+
+    // the sample kit as written into the plugin state, rebuilt whenever a kit is loaded
+    juce::MemoryBlock sampleKitState;
     
-    //number of voices
+    //number of voices, melodic and noise channel
     int voiceCount = 16;
+    int drumVoiceCount = 8;
+
+    // editor feed and processBlock timing
+    VisualiserFeed visualiserFeed;
+    std::atomic<float> audioLoad { 0.0f };
+
+    // lowers quality in steps when processBlock runs over the CPU budget
+    LoadGovernor loadGovernor;
+    std::atomic<float>* cpuBudgetParam = nullptr;
+    static constexpr int voiceLimitUnderLoad = 8;
 
     // param tree
     juce::AudioProcessorValueTreeState apvts;
 
+    // binary save/restore of apvts, must be declared after it
+    PackedState packedState { apvts };
+
+    // hands preset changes to the audio thread whole, at a block boundary; built in the constructor
+    PresetSwitcher presetSwitcher;
+    std::atomic<float>* presetFadeParam = nullptr;
+    std::atomic<bool> processing { false };
+
+    /** Applies a packed state, through the PresetSwitcher while blocks are being processed. */
+    bool restorePackedState(const void* data, int sizeInBytes);
+
+    // presets on disk, exposed to the host as programs
+    PresetLibrary presetLibrary;
+    std::atomic<int> currentProgram { 0 };
+
     juce::AudioProcessorValueTreeState::ParameterLayout
         createParameterLayout()
     {
         juce::AudioProcessorValueTreeState::ParameterLayout layout;
         
         //choose channel
-        layout.add(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("mode", 1),"Type", juce::StringArray{"Bass", "Pulse", "Noise/Drum"}, 1));
+        layout.add(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("mode", 1),"Type", juce::StringArray{"Bass", "Pulse", "Noise/Drum", "VRC6 Pulse", "VRC6 Saw", "N163"}, 1));
             
         // env params
         layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("attack", 1), "Attack", 0.001, 1.0, 0.01));
@@ -94,6 +249,38 @@ private:
 
         //pitch offset
         layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("pitchOffset", 1),"Pitch Offset", -12.0, 12.0, 0.0));
+
+        // pulse sweep unit, same ranges as the 2A03 sweep register
+        layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID("sweepEnabled", 1), "Sweep", false));
+        layout.add(std::make_unique<juce::AudioParameterInt>(juce::ParameterID("sweepPeriod", 1), "Sweep Period", 0, 7, 3));
+        layout.add(std::make_unique<juce::AudioParameterInt>(juce::ParameterID("sweepShift", 1), "Sweep Shift", 0, 7, 2));
+        layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID("sweepNegate", 1), "Sweep Up", false));
+
+        // pitch bend, the MPE range applies to per-note bends on member channels
+        layout.add(std::make_unique<juce::AudioParameterInt>(juce::ParameterID("bendRange", 1), "Bend Range", 0, 24, 2));
+        layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID("mpeEnabled", 1), "MPE", false));
+        layout.add(std::make_unique<juce::AudioParameterInt>(juce::ParameterID("mpeBendRange", 1), "MPE Bend Range", 0, 96, 48));
+
+        // expansion chips: VRC6 pulse duty in sixteenths, N163 wave and channel multiplexing
+        layout.add(std::make_unique<juce::AudioParameterInt>(juce::ParameterID("vrc6Duty", 1), "VRC6 Duty", 1, 8, 8));
+        layout.add(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("n163Wave", 1), "N163 Wave", juce::StringArray{"Sine", "Triangle", "Saw", "Square", "Organ"}, 0));
+        layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID("n163Multiplex", 1), "N163 Multiplex", true));
+
+        // replay the attack and decay of repeated notes from a cache, restarting oscillators at note on
+        layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID("renderCache", 1), "Note Cache", false));
+
+        // share of each block's real time processBlock may use before quality is lowered
+        layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("cpuBudget", 1), "CPU Budget", 0.1f, 1.0f, 0.75f));
+
+        // effect mode: crush the input like the voices, with the synth mixed in at inputSynthMix
+        layout.add(std::make_unique<juce::AudioParameterBool>(juce::ParameterID("inputEffect", 1), "Input Effect", false));
+        layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("inputSynthMix", 1), "Input Synth Mix", 0.0f, 1.0f, 0.0f));
+
+        // output dip around a preset change, 0 to switch on the block boundary without one
+        layout.add(std::make_unique<juce::AudioParameterFloat>(juce::ParameterID("presetFade", 1), "Preset Fade (ms)", 0.0f, 50.0f, 10.0f));
+
+        // lock the bit-depth LFO to the host's bars and beats instead of LFO Rate
+        layout.add(std::make_unique<juce::AudioParameterChoice>(juce::ParameterID("lfoSync", 1), "LFO Sync", TransportLFO::getSyncNames(), 0));
         
         //turn arp on or off
             
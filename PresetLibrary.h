@@ -0,0 +1,358 @@
+/*
+  ==============================================================================
+
+    PresetLibrary.h
+    Created: 18 Oct 2026 11:40:51am
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "AllocationTracer.h"
+
+/**
+ * One entry of the preset index. Only the small header of each preset file is read while scanning;
+ * the packed parameter state itself stays on disk until the preset is selected.
+ */
+struct PresetInfo
+{
+    juce::String name;
+    juce::String tags;
+    juce::String searchKey; // lower-case "name tags", so searches don't have to convert every entry
+    juce::File file;
+    juce::uint64 parameterHash = 0;
+    int mode = 0;
+};
+
+/**
+ * A directory of .nespreset files, indexed on a background thread.
+ *
+ * File layout (little-endian):
+ *
+ *     uint32 magic | uint32 version | uint32 mode | uint64 parameter hash | name | tags | uint32 size | packed state
+ *
+ * where name and tags are null-terminated UTF-8 strings and the packed state is a PackedState blob. The
+ * index is an immutable array swapped in atomically once a scan completes, so readers never wait on the
+ * scanner. Loading a preset's parameter block also happens on the background thread; the result is handed
+ * back on the message thread through onPresetLoaded. The audio thread never touches any of this.
+ */
+class PresetLibrary : private juce::Thread, private juce::AsyncUpdater
+{
+public:
+    using Index = juce::Array<PresetInfo>;
+
+    static constexpr juce::uint32 magic = 0x5053454e; // "NESP"
+    static constexpr juce::uint32 version = 1;
+
+    /** Called on the message thread whenever a new index has been published. */
+    std::function<void()> onIndexChanged;
+
+    /** Called on the message thread with the packed state of a preset requested through loadPreset. */
+    std::function<void(int index, const juce::MemoryBlock& packedState)> onPresetLoaded;
+
+    PresetLibrary() : juce::Thread("Preset library")
+    {
+    }
+
+    ~PresetLibrary() override
+    {
+        cancelPendingUpdate();
+        stopThread(4000);
+    }
+
+    /**
+     * Default location of the user's presets.
+     * @return The preset directory inside the user's application data folder.
+     */
+    static juce::File getDefaultDirectory()
+    {
+        return juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+                   .getChildFile("NES Synth").getChildFile("Presets");
+    }
+
+    /**
+     * Starts (or restarts) indexing a directory in the background.
+     * @param newDirectory The folder to scan, including subfolders.
+     */
+    void setDirectory(const juce::File& newDirectory)
+    {
+        {
+            const std::lock_guard<TracedMutex> lock(requestLock);
+            directory = newDirectory;
+        }
+
+        rescanRequested = true;
+
+        if (! isThreadRunning())
+            startThread();
+
+        notify();
+    }
+
+    /** Scans the current directory again, e.g. after presets have been saved. */
+    void rescan()
+    {
+        setDirectory(getDirectory());
+    }
+
+    juce::File getDirectory() const
+    {
+        const std::lock_guard<TracedMutex> lock(requestLock);
+        return directory;
+    }
+
+    /**
+     * Returns the current index. The returned array is never modified, so it can be held on to
+     * while a new scan is running.
+     */
+    std::shared_ptr<const Index> getIndex() const
+    {
+        return std::atomic_load(&index);
+    }
+
+    int getNumPresets() const
+    {
+        return getIndex()->size();
+    }
+
+    /**
+     * Finds presets whose name or tags contain every word of the query.
+     * @param query Space-separated search terms, case-insensitive. An empty query matches everything.
+     * @param modeFilter Only return presets for this channel mode, or -1 for any mode.
+     * @return Positions of the matching presets in the current index.
+     */
+    juce::Array<int> search(const juce::String& query, int modeFilter = -1) const
+    {
+        juce::StringArray terms;
+        terms.addTokens(query.toLowerCase(), " ", "\"");
+        terms.removeEmptyStrings();
+
+        auto current = getIndex();
+        juce::Array<int> results;
+        results.ensureStorageAllocated(current->size());
+
+        for (int i = 0; i < current->size(); ++i)
+        {
+            const auto& preset = current->getReference(i);
+
+            if (modeFilter >= 0 && preset.mode != modeFilter)
+                continue;
+
+            bool matches = true;
+            for (const auto& term : terms)
+            {
+                if (! preset.searchKey.contains(term))
+                {
+                    matches = false;
+                    break;
+                }
+            }
+
+            if (matches)
+                results.add(i);
+        }
+
+        return results;
+    }
+
+    /**
+     * Asks the background thread to read the full contents of a preset. onPresetLoaded is called
+     * on the message thread once it is available; if another preset is requested in the meantime,
+     * only the latest request is delivered. A request made while a scan is running waits for it,
+     * so it refers to the index the scan publishes.
+     * @param presetIndex Position of the preset in the index.
+     */
+    void loadPreset(int presetIndex)
+    {
+        pendingLoad.store(presetIndex);
+        notify();
+    }
+
+    /**
+     * Writes a preset file. The index is not updated until the next rescan.
+     * @param file Destination file.
+     * @param name Display name.
+     * @param tags Free-form, space-separated tags.
+     * @param mode Channel mode the preset was made for.
+     * @param packedState A blob written by PackedState::save.
+     * @return True if the file was written.
+     */
+    static bool savePreset(const juce::File& file, const juce::String& name, const juce::String& tags,
+                           int mode, const juce::MemoryBlock& packedState)
+    {
+        juce::MemoryOutputStream out;
+        out.writeInt((int) magic);
+        out.writeInt((int) version);
+        out.writeInt(mode);
+        out.writeInt64((juce::int64) hashState(packedState));
+        out.writeString(name);
+        out.writeString(tags);
+        out.writeInt((int) packedState.getSize());
+        out.write(packedState.getData(), packedState.getSize());
+
+        file.getParentDirectory().createDirectory();
+        return file.replaceWithData(out.getData(), out.getDataSize());
+    }
+
+    /**
+     * Reads the packed parameter state out of a preset file, on the calling thread.
+     * @param file A .nespreset file.
+     * @param packedState Receives the PackedState blob.
+     * @return False if the file couldn't be read or isn't a preset this build understands.
+     */
+    static bool readPresetState(const juce::File& file, juce::MemoryBlock& packedState)
+    {
+        juce::FileInputStream in(file);
+
+        if (! in.openedOk() || (juce::uint32) in.readInt() != magic || (juce::uint32) in.readInt() > version)
+            return false;
+
+        in.readInt();   // mode
+        in.readInt64(); // hash
+        in.readString();
+        in.readString();
+
+        const int size = in.readInt();
+        if (size <= 0 || size > in.getNumBytesRemaining())
+            return false;
+
+        packedState.setSize((size_t) size);
+        return in.read(packedState.getData(), size) == size;
+    }
+
+    /**
+     * FNV-1a hash of a packed parameter block, used to spot duplicate presets.
+     * @param packedState A blob written by PackedState::save.
+     */
+    static juce::uint64 hashState(const juce::MemoryBlock& packedState)
+    {
+        juce::uint64 hash = 0xcbf29ce484222325ull;
+        auto* bytes = static_cast<const juce::uint8*>(packedState.getData());
+
+        for (size_t i = 0; i < packedState.getSize(); ++i)
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+
+        return hash;
+    }
+
+private:
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            if (rescanRequested.exchange(false))
+                scan(getDirectory());
+
+            // a load waits until the index it refers to has been published
+            if (rescanRequested.load() || ! indexPublished.load())
+                continue;
+
+            const int toLoad = pendingLoad.exchange(-1);
+            if (toLoad >= 0)
+                load(toLoad);
+
+            if (! rescanRequested && pendingLoad.load() < 0)
+                wait(-1);
+        }
+    }
+
+    void scan(const juce::File& dir)
+    {
+        auto newIndex = std::make_shared<Index>();
+
+        if (dir.isDirectory())
+        {
+            for (const auto& entry : juce::RangedDirectoryIterator(dir, true, "*.nespreset", juce::File::findFiles))
+            {
+                if (threadShouldExit())
+                    return;
+
+                PresetInfo info;
+                if (readHeader(entry.getFile(), info))
+                    newIndex->add(std::move(info));
+            }
+        }
+
+        std::sort(newIndex->begin(), newIndex->end(),
+                  [](const PresetInfo& a, const PresetInfo& b) { return a.name.compareNatural(b.name) < 0; });
+
+        std::atomic_store(&index, std::shared_ptr<const Index>(std::move(newIndex)));
+        indexPublished = true;
+        indexChanged = true;
+        triggerAsyncUpdate();
+    }
+
+    static bool readHeader(const juce::File& file, PresetInfo& info)
+    {
+        juce::FileInputStream in(file);
+
+        if (! in.openedOk() || (juce::uint32) in.readInt() != magic || (juce::uint32) in.readInt() > version)
+            return false;
+
+        info.mode = in.readInt();
+        info.parameterHash = (juce::uint64) in.readInt64();
+        info.name = in.readString();
+        info.tags = in.readString();
+        info.file = file;
+
+        if (info.name.isEmpty())
+            info.name = file.getFileNameWithoutExtension();
+
+        info.searchKey = (info.name + " " + info.tags).toLowerCase();
+        return ! in.isExhausted();
+    }
+
+    void load(int presetIndex)
+    {
+        auto current = getIndex();
+
+        if (! juce::isPositiveAndBelow(presetIndex, current->size()))
+            return;
+
+        juce::MemoryBlock state;
+        if (! readPresetState(current->getReference(presetIndex).file, state))
+            return;
+
+        {
+            const std::lock_guard<TracedMutex> lock(requestLock);
+            loadedState = std::move(state);
+            loadedIndex = presetIndex;
+        }
+
+        triggerAsyncUpdate();
+    }
+
+    void handleAsyncUpdate() override
+    {
+        if (indexChanged.exchange(false) && onIndexChanged)
+            onIndexChanged();
+
+        juce::MemoryBlock state;
+        int loaded = -1;
+
+        {
+            const std::lock_guard<TracedMutex> lock(requestLock);
+            std::swap(loaded, loadedIndex);
+            state.swapWith(loadedState);
+        }
+
+        if (loaded >= 0 && onPresetLoaded)
+            onPresetLoaded(loaded, state);
+    }
+
+    mutable TracedMutex requestLock;
+    juce::File directory;
+    juce::MemoryBlock loadedState;
+    int loadedIndex = -1;
+
+    std::atomic<bool> rescanRequested { false };
+    std::atomic<int> pendingLoad { -1 };
+    std::atomic<bool> indexChanged { false };
+    std::atomic<bool> indexPublished { false };
+    std::shared_ptr<const Index> index = std::make_shared<const Index>();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PresetLibrary)
+};
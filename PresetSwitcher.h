@@ -0,0 +1,238 @@
+/*
+  ==============================================================================
+
+    PresetSwitcher.h
+    Created: 19 Oct 2026 12:46:03am
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PackedState.h"
+#include "AllocationTracer.h"
+
+/**
+ * Switches presets between blocks, all parameters at once, instead of one setValueNotifyingHost at a
+ * time while the audio thread is reading them.
+ *
+ * A preset is read into a complete snapshot of the parameter values on whichever thread asks for it,
+ * and the snapshot is posted to the audio thread through a single atomic slot index. At the start of a
+ * block the audio thread takes it and, with a fade length set, fades that block out and writes the
+ * values into the parameters' atomics at the start of the next block, which it fades in; without a
+ * fade it writes them straight away. The audio thread never waits and never allocates: the snapshots
+ * live in a fixed pool of three, each with an atomic state, so a free one always exists for the next
+ * preset while one waits and another is being copied.
+ *
+ * The host and editor are told about the new values afterwards, from a timer on the message thread,
+ * which reads them from the audio thread's last applied copy; the parameter objects themselves still
+ * hold the old preset until then, so that is also when getStateInformation starts saving the new one.
+ * The same timer applies a snapshot itself if no block has come to collect it, e.g. while the host
+ * has stopped processing.
+ */
+class PresetSwitcher : private juce::Timer
+{
+public:
+    /**
+     * @param packedState Reads the preset blobs and knows the parameters.
+     * @param apvts Tree whose raw values the audio thread updates.
+     * @param notifyHost False for a headless engine: no timer, so switches are only applied by blocks.
+     */
+    PresetSwitcher(PackedState& packedState, juce::AudioProcessorValueTreeState& apvts, bool notifyHost = true)
+        : state(packedState)
+    {
+        for (int i = 0; i < PackedState::numParameters; ++i)
+            values[(size_t) i] = apvts.getRawParameterValue(PackedState::parameterIds[i]);
+
+        if (notifyHost)
+            startTimerHz(20);
+    }
+
+    ~PresetSwitcher() override
+    {
+        stopTimer();
+    }
+
+    /**
+     * Reads a packed preset and posts it to the audio thread. Not for the audio thread.
+     * @param data A PackedState blob.
+     * @param sizeInBytes Size of the blob.
+     * @return False if the blob isn't a packed state this build can read.
+     */
+    bool publish(const void* data, int sizeInBytes)
+    {
+        const std::lock_guard<TracedMutex> lock(publishLock); // between publishers only
+
+        int slot = 0;
+        for (int expected = free; ! snapshots[(size_t) slot].state.compare_exchange_strong(expected, writing); expected = free)
+            slot = (slot + 1) % numSnapshots; // one is always free, see the class description
+
+        auto& snapshot = snapshots[(size_t) slot];
+        snapshot.count = state.read(data, sizeInBytes, snapshot.values);
+
+        if (snapshot.count < 0)
+        {
+            snapshot.state.store(free);
+            return false;
+        }
+
+        snapshot.state.store(posted);
+        const int replaced = postedSlot.exchange(slot);
+
+        // posted again before the audio thread came for it, only the newest counts
+        if (replaced >= 0)
+            snapshots[(size_t) replaced].state.store(free);
+
+        return true;
+    }
+
+    //==============================================================================
+    /**
+     * Audio thread, start of a block: applies a preset whose fade-out has finished and picks up a newly
+     * posted one.
+     * @param fadeSamples Length of the fade around a switch, 0 to switch without one.
+     */
+    void beginBlock(int fadeSamples)
+    {
+        fadingOut = false;
+
+        if (staged)
+        {
+            applyStaged();
+            fadeInLength = fadeInRemaining = fadeLength;
+            return;
+        }
+
+        if (! take(stagedValues, stagedCount))
+            return;
+
+        fadeLength = fadeSamples;
+
+        if (fadeLength > 0)
+            staged = fadingOut = true; // the new values go in at the start of the next block
+        else
+            applyStaged();
+    }
+
+    /**
+     * Audio thread, end of a block: fades the output out ahead of a switch, or back in after one.
+     * @param buffer The block's output.
+     */
+    void processFade(juce::AudioBuffer<float>& buffer)
+    {
+        const int numSamples = buffer.getNumSamples();
+
+        if (fadingOut)
+        {
+            // reaches silence within this block, however short it is
+            const int length = juce::jmin(fadeLength, numSamples);
+
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+                buffer.applyGainRamp(channel, numSamples - length, length, 1.0f, 0.0f);
+        }
+        else if (fadeInRemaining > 0)
+        {
+            const int length = juce::jmin(fadeInRemaining, numSamples);
+            const float from = 1.0f - (float) fadeInRemaining / (float) fadeInLength;
+            const float to = 1.0f - (float) (fadeInRemaining - length) / (float) fadeInLength;
+
+            for (int channel = 0; channel < buffer.getNumChannels(); ++channel)
+                buffer.applyGainRamp(channel, 0, length, from, to);
+
+            fadeInRemaining -= length;
+        }
+    }
+
+private:
+    enum SnapshotState { free, writing, posted, reading };
+    static constexpr int numSnapshots = 3;
+
+    struct Snapshot
+    {
+        std::array<float, PackedState::numParameters> values {};
+        int count = 0;
+        std::atomic<int> state { free };
+    };
+
+    /**
+     * Copies the posted snapshot out and frees its slot, if one is posted. Only one caller can win a
+     * snapshot, so the audio thread and the timer never both apply it.
+     */
+    bool take(std::array<float, PackedState::numParameters>& dest, int& count)
+    {
+        const int slot = postedSlot.exchange(-1);
+        if (slot < 0)
+            return false;
+
+        auto& snapshot = snapshots[(size_t) slot];
+        snapshot.state.store(reading);
+        dest = snapshot.values;
+        count = snapshot.count;
+        snapshot.state.store(free);
+        return true;
+    }
+
+    void applyStaged()
+    {
+        for (int i = 0; i < stagedCount; ++i)
+        {
+            values[(size_t) i]->store(stagedValues[(size_t) i]);
+            appliedValues[(size_t) i].store(stagedValues[(size_t) i], std::memory_order_relaxed);
+        }
+
+        appliedCount.store(stagedCount, std::memory_order_relaxed);
+        staged = false;
+        appliedSwitches.fetch_add(1, std::memory_order_release);
+    }
+
+    void timerCallback() override
+    {
+        // nobody is processing, so nothing can read a half-applied preset; apply it here
+        ticksWaiting = postedSlot.load() >= 0 ? ticksWaiting + 1 : 0;
+
+        std::array<float, PackedState::numParameters> taken;
+        int count = 0;
+
+        if (ticksWaiting > 10 && take(taken, count))
+            for (int i = 0; i < count; ++i)
+                if (auto* parameter = state.getParameter(i))
+                    parameter->setValueNotifyingHost(parameter->convertTo0to1(taken[(size_t) i]));
+
+        // the audio thread has written the values, now let the host and editor know; a switch applied
+        // while they are being read is picked up on the next pass, so the newest preset always wins
+        for (auto switches = appliedSwitches.load(std::memory_order_acquire); switches != notifiedSwitches;
+             switches = appliedSwitches.load(std::memory_order_acquire))
+        {
+            notifiedSwitches = switches;
+            const int count = appliedCount.load(std::memory_order_relaxed);
+
+            for (int i = 0; i < count; ++i)
+                if (auto* parameter = state.getParameter(i))
+                    parameter->setValueNotifyingHost(parameter->convertTo0to1(appliedValues[(size_t) i].load(std::memory_order_relaxed)));
+        }
+    }
+
+    PackedState& state;
+    std::array<std::atomic<float>*, PackedState::numParameters> values {};
+
+    std::array<Snapshot, numSnapshots> snapshots;
+    std::atomic<int> postedSlot { -1 };
+    TracedMutex publishLock;
+
+    // audio thread
+    std::array<float, PackedState::numParameters> stagedValues {};
+    int stagedCount = 0;
+    bool staged = false, fadingOut = false;
+    int fadeLength = 0, fadeInLength = 0, fadeInRemaining = 0;
+
+    // written by the audio thread, read by the timer
+    std::array<std::atomic<float>, PackedState::numParameters> appliedValues {};
+    std::atomic<int> appliedCount { 0 };
+    std::atomic<juce::uint32> appliedSwitches { 0 };
+
+    // message thread
+    juce::uint32 notifiedSwitches = 0;
+    int ticksWaiting = 0;
+};
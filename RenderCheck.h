@@ -0,0 +1,149 @@
+/*
+  ==============================================================================
+
+    RenderCheck.h
+    Created: 19 Oct 2026 1:47:26am
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+/**
+ * Renders the same preset and MIDI at several block sizes and compares hashes of the audio, to check
+ * that the engine's output doesn't depend on how the host splits it into blocks. Cached notes, frozen
+ * tracks and the sample pack renderer all rely on that.
+ *
+ * The corpus is the block sizes 1, 17, 64, 512 and 4096, plus one take that cycles through all of them
+ * so block boundaries fall at irregular places. Every take uses a fresh, headless, non-realtime engine,
+ * so the load governor never lowers quality and preset changes apply at once.
+ *
+ * What the guarantee doesn't cover: voices are handed out at the start of each block, so if more notes
+ * are sounding than there are voices the one stolen can differ, and N163 multiplexing counts channels
+ * once per block.
+ */
+class RenderCheck
+{
+public:
+    struct Take
+    {
+        juce::Array<int> blockSizes; // used in turn, from the start of the render
+        juce::uint64 hash = 0;
+    };
+
+    /** Block sizes each rendered on their own, and all together as one irregular split. */
+    static juce::Array<int> getCorpusBlockSizes()
+    {
+        return { 1, 17, 64, 512, 4096 };
+    }
+
+    /**
+     * Renders the corpus and compares the takes.
+     * @param state A PackedState blob, or empty for the default parameters.
+     * @param midi The MIDI to play, with sample positions from the start of the render.
+     * @param numSamples Length of the render.
+     * @param sampleRate Sample rate to render at.
+     * @param takes Receives each take's block sizes and hash.
+     * @param playHead The host's play head every take sees, or nullptr for none.
+     * @return True if every take rendered and hashed the same.
+     */
+    static bool check(const juce::MemoryBlock& state, const juce::MidiBuffer& midi, int numSamples, double sampleRate,
+                      juce::Array<Take>& takes, juce::AudioPlayHead* playHead = nullptr)
+    {
+        const auto sizes = getCorpusBlockSizes();
+
+        takes.clearQuick();
+        for (auto size : sizes)
+            takes.add({ { size }, 0 });
+
+        takes.add({ sizes, 0 });
+
+        bool identical = true;
+        for (auto& take : takes)
+        {
+            const bool rendered = render(state, midi, numSamples, sampleRate, take.blockSizes, take.hash, nullptr, playHead);
+            identical = identical && rendered && take.hash == takes.getReference(0).hash;
+        }
+
+        return identical;
+    }
+
+    /**
+     * Renders with a fresh engine and hashes the output.
+     * @param state A PackedState blob, or empty for the default parameters.
+     * @param midi The MIDI to play, with sample positions from the start of the render.
+     * @param numSamples Length of the render.
+     * @param sampleRate Sample rate to render at.
+     * @param blockSizes Sizes of the blocks, used in turn and repeated until the render is done.
+     * @param outputHash Receives the hash of the output.
+     * @param audio If not nullptr, receives the rendered stereo audio.
+     * @param playHead The host's play head, or nullptr for none.
+     * @return False, with nothing rendered, if the preset's sample kit didn't load in time.
+     */
+    static bool render(const juce::MemoryBlock& state, const juce::MidiBuffer& midi, int numSamples,
+                       double sampleRate, const juce::Array<int>& blockSizes, juce::uint64& outputHash,
+                       juce::AudioBuffer<float>* audio = nullptr, juce::AudioPlayHead* playHead = nullptr)
+    {
+        int maximumBlockSize = 1;
+        for (auto size : blockSizes)
+            maximumBlockSize = juce::jmax(maximumBlockSize, size);
+
+        SynthExampleAudioProcessor engine(true);
+        engine.setNonRealtime(true);
+        engine.setPlayHead(playHead);
+        engine.setRateAndBufferSizeDetails(sampleRate, maximumBlockSize);
+
+        if (state.getSize() > 0)
+            engine.setStateInformation(state.getData(), (int) state.getSize());
+
+        engine.prepareToPlay(sampleRate, maximumBlockSize);
+
+        // a drum part rendered without its samples would hash as a different take
+        if (! engine.waitForSampleKit(10000))
+            return false;
+
+        juce::AudioBuffer<float> output(2, numSamples);
+        juce::MidiBuffer blockMidi;
+        int position = 0;
+
+        for (int i = 0; position < numSamples; ++i)
+        {
+            const int blockSize = juce::jmax(1, blockSizes.isEmpty() ? 1 : blockSizes[i % blockSizes.size()]);
+            const int length = juce::jmin(blockSize, numSamples - position);
+            juce::AudioBuffer<float> block(output.getArrayOfWritePointers(), 2, position, length);
+
+            block.clear();
+            blockMidi.clear();
+            blockMidi.addEvents(midi, position, length, -position);
+
+            engine.processBlock(block, blockMidi);
+            position += length;
+        }
+
+        if (audio != nullptr)
+            audio->makeCopyOf(output);
+
+        outputHash = hash(output);
+        return true;
+    }
+
+    /** FNV-1a over the bit patterns of every sample, channel by channel. */
+    static juce::uint64 hash(const juce::AudioBuffer<float>& audio)
+    {
+        NoteRenderCache::Key key;
+
+        for (int channel = 0; channel < audio.getNumChannels(); ++channel)
+        {
+            const float* samples = audio.getReadPointer(channel);
+
+            for (int i = 0; i < audio.getNumSamples(); ++i)
+                key.add(samples[i]);
+        }
+
+        return key.hash;
+    }
+};
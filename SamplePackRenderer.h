@@ -0,0 +1,300 @@
+/*
+  ==============================================================================
+
+    SamplePackRenderer.h
+    Created: 18 Oct 2026 11:52:19pm
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+/**
+ * Renders sample packs offline: every preset, at every note, velocity and held length asked for, each
+ * written to its own WAV file, with a manifest.json describing the lot.
+ *
+ * The job matrix is spread over a thread pool with one worker per core. Each worker owns a complete,
+ * independent SynthExampleAudioProcessor and takes the next job from a shared counter, so workers never
+ * wait on one another and throughput grows with the number of cores. A take ends as soon as every
+ * envelope has finished and any reverb tail has decayed below the silence threshold; trailing silence
+ * is trimmed off before the file is written.
+ *
+ * The engines are headless: they don't scan the preset folder or start timers, so the renderer runs
+ * from a command-line host as well as from a background thread of the plugin.
+ */
+class SamplePackRenderer
+{
+public:
+    struct Preset
+    {
+        juce::String name;
+        juce::MemoryBlock state; // a PackedState blob
+    };
+
+    struct Settings
+    {
+        double sampleRate = 48000.0;
+        int blockSize = 512;
+        int bitDepth = 24;
+
+        juce::Array<int> notes { 60 };
+        juce::Array<int> velocities { 100 };
+        juce::Array<double> lengths { 1.0 }; // seconds each note is held
+
+        float silenceThreshold = 0.0001f; // about -80 dBFS
+        double maxTailSeconds = 10.0;     // cut-off for notes that never fall silent
+    };
+
+    /**
+     * Reads the packed state of every preset in an index.
+     * @param index A PresetLibrary index.
+     * @return The presets that could be read, named as in the index.
+     */
+    static juce::Array<Preset> readPresets(const PresetLibrary::Index& index)
+    {
+        juce::Array<Preset> presets;
+
+        for (const auto& info : index)
+        {
+            Preset preset { info.name, {} };
+            if (PresetLibrary::readPresetState(info.file, preset.state))
+                presets.add(std::move(preset));
+        }
+
+        return presets;
+    }
+
+    /**
+     * Renders the whole matrix and writes the pack, blocking until it is done or cancelled.
+     * @param presets The presets to render.
+     * @param settings Notes, velocities, lengths and output format.
+     * @param outputDirectory Where the WAV files and manifest.json go; created if missing.
+     * @return True if every file and the manifest were written.
+     */
+    bool render(const juce::Array<Preset>& presets, const Settings& settings, const juce::File& outputDirectory)
+    {
+        jobs.clearQuick();
+        for (int preset = 0; preset < presets.size(); ++preset)
+            for (auto note : settings.notes)
+                for (auto velocity : settings.velocities)
+                    for (auto length : settings.lengths)
+                        jobs.add({ preset, note, velocity, length });
+
+        if (jobs.isEmpty() || outputDirectory.createDirectory().failed())
+            return false;
+
+        results.clearQuick();
+        results.insertMultiple(0, {}, jobs.size());
+        nextJob = 0;
+        finishedJobs = 0;
+        cancelled = false;
+
+        const int numWorkers = juce::jmin(juce::SystemStats::getNumCpus(), jobs.size());
+        juce::ThreadPool pool(numWorkers);
+        juce::OwnedArray<Worker> workers;
+
+        for (int i = 0; i < numWorkers; ++i)
+            pool.addJob(workers.add(new Worker(*this, presets, settings, outputDirectory)), false);
+
+        for (auto* worker : workers)
+            pool.waitForJobToFinish(worker, -1);
+
+        bool allWritten = ! cancelled;
+        for (const auto& result : results)
+            allWritten = allWritten && result.written;
+
+        return writeManifest(presets, settings, outputDirectory) && allWritten;
+    }
+
+    /** Stops a render in progress; takes already being rendered are finished first. */
+    void cancel()
+    {
+        cancelled = true;
+    }
+
+    /** Fraction of the current render's jobs finished, from 0 to 1. */
+    double getProgress() const
+    {
+        const int total = jobs.size();
+        return total > 0 ? (double) finishedJobs.load() / total : 0.0;
+    }
+
+private:
+    struct Job
+    {
+        int preset;
+        int note;
+        int velocity;
+        double length;
+    };
+
+    struct Result
+    {
+        juce::String fileName;
+        int numSamples = 0;
+        bool written = false;
+    };
+
+    /** One thread's engine, rendering jobs until the matrix runs out. */
+    class Worker : public juce::ThreadPoolJob
+    {
+    public:
+        Worker(SamplePackRenderer& r, const juce::Array<Preset>& p, const Settings& s, const juce::File& dir)
+            : juce::ThreadPoolJob("Sample pack worker"), renderer(r), presets(p), settings(s), directory(dir)
+        {
+        }
+
+        JobStatus runJob() override
+        {
+            // built here so the engine's memory is first touched by the thread that uses it
+            SynthExampleAudioProcessor engine(true);
+            engine.setNonRealtime(true);
+            engine.setRateAndBufferSizeDetails(settings.sampleRate, settings.blockSize);
+            engine.prepareToPlay(settings.sampleRate, settings.blockSize);
+
+            double longest = 0.0;
+            for (auto length : settings.lengths)
+                longest = juce::jmax(longest, length);
+
+            take.setSize(2, (int) ((longest + settings.maxTailSeconds) * settings.sampleRate) + settings.blockSize);
+
+            for (int index = renderer.nextJob++; index < renderer.jobs.size(); index = renderer.nextJob++)
+            {
+                if (shouldExit() || renderer.cancelled)
+                    break;
+
+                renderer.results.getReference(index) = renderJob(engine, renderer.jobs.getReference(index));
+                ++renderer.finishedJobs;
+            }
+
+            return jobHasFinished;
+        }
+
+    private:
+        Result renderJob(SynthExampleAudioProcessor& engine, const Job& job)
+        {
+            const auto& preset = presets.getReference(job.preset);
+            engine.setStateInformation(preset.state.getData(), (int) preset.state.getSize());
+
+            // also clears the reverb and crush state the previous take left behind
+            engine.prepareToPlay(settings.sampleRate, settings.blockSize);
+
+            // a take without its samples would be silent or wrong; the job fails instead
+            if (! engine.waitForSampleKit(10000))
+                return {};
+
+            const int heldSamples = (int) (job.length * settings.sampleRate);
+            const int maxSamples = juce::jmin(take.getNumSamples(), heldSamples + (int) (settings.maxTailSeconds * settings.sampleRate));
+            int position = 0;
+
+            while (position < maxSamples)
+            {
+                const int numSamples = juce::jmin(settings.blockSize, maxSamples - position);
+                juce::AudioBuffer<float> block(take.getArrayOfWritePointers(), 2, position, numSamples);
+
+                midi.clear();
+                if (position == 0)
+                    midi.addEvent(juce::MidiMessage::noteOn(1, job.note, (juce::uint8) job.velocity), 0);
+                if (heldSamples >= position && heldSamples < position + numSamples)
+                    midi.addEvent(juce::MidiMessage::noteOff(1, job.note), heldSamples - position);
+
+                engine.processBlock(block, midi);
+                position += numSamples;
+
+                // the envelopes are done once no voice is left, only an effect tail can still be ringing
+                if (position > heldSamples && ! engine.hasActiveVoices()
+                    && block.getMagnitude(0, 0, numSamples) < settings.silenceThreshold
+                    && block.getMagnitude(1, 0, numSamples) < settings.silenceThreshold)
+                    break;
+            }
+
+            Result result;
+            result.numSamples = juce::jmax(1, findEndOfSound(position));
+            result.fileName = juce::File::createLegalFileName(preset.name) + "_" + juce::String(job.note)
+                                + "_v" + juce::String(job.velocity) + "_" + juce::String(juce::roundToInt(job.length * 1000.0)) + "ms.wav";
+            result.written = writeWav(directory.getChildFile(result.fileName), result.numSamples);
+            return result;
+        }
+
+        /** Length of the take with its trailing silence trimmed. */
+        int findEndOfSound(int numSamples) const
+        {
+            const float* left = take.getReadPointer(0);
+            const float* right = take.getReadPointer(1);
+
+            while (numSamples > 0 && std::abs(left[numSamples - 1]) < settings.silenceThreshold
+                                  && std::abs(right[numSamples - 1]) < settings.silenceThreshold)
+                --numSamples;
+
+            return numSamples;
+        }
+
+        bool writeWav(const juce::File& file, int numSamples)
+        {
+            file.deleteFile();
+            auto stream = std::make_unique<juce::FileOutputStream>(file);
+
+            if (! stream->openedOk())
+                return false;
+
+            juce::WavAudioFormat wav;
+            std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(stream.get(), settings.sampleRate, 2,
+                                                                                settings.bitDepth, {}, 0));
+            if (writer == nullptr)
+                return false;
+
+            stream.release(); // the writer owns it now
+            return writer->writeFromAudioSampleBuffer(take, 0, numSamples);
+        }
+
+        SamplePackRenderer& renderer;
+        const juce::Array<Preset>& presets;
+        const Settings& settings;
+        const juce::File directory;
+
+        juce::AudioBuffer<float> take;
+        juce::MidiBuffer midi;
+    };
+
+    bool writeManifest(const juce::Array<Preset>& presets, const Settings& settings, const juce::File& directory) const
+    {
+        juce::Array<juce::var> samples;
+
+        for (int i = 0; i < jobs.size(); ++i)
+        {
+            const auto& job = jobs.getReference(i);
+            const auto& result = results.getReference(i);
+
+            if (! result.written)
+                continue;
+
+            auto* sample = new juce::DynamicObject();
+            sample->setProperty("file", result.fileName);
+            sample->setProperty("preset", presets.getReference(job.preset).name);
+            sample->setProperty("note", job.note);
+            sample->setProperty("velocity", job.velocity);
+            sample->setProperty("heldSeconds", job.length);
+            sample->setProperty("numSamples", result.numSamples);
+            samples.add(juce::var(sample));
+        }
+
+        auto* manifest = new juce::DynamicObject();
+        manifest->setProperty("sampleRate", settings.sampleRate);
+        manifest->setProperty("bitDepth", settings.bitDepth);
+        manifest->setProperty("samples", samples);
+
+        return directory.getChildFile("manifest.json").replaceWithText(juce::JSON::toString(juce::var(manifest)));
+    }
+
+    juce::Array<Job> jobs;
+    juce::Array<Result> results; // one per job, each written only by the worker that rendered it
+
+    std::atomic<int> nextJob { 0 }, finishedJobs { 0 };
+    std::atomic<bool> cancelled { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SamplePackRenderer)
+};
@@ -0,0 +1,556 @@
+/*
+  ==============================================================================
+
+    SampleSet.h
+    Created: 18 Oct 2026 8:14:52pm
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "AllocationTracer.h"
+
+/**
+ * Where one sample of a kit comes from and which notes play it. The source is either the full path
+ * of an audio file or builtInPrefix followed by the name of a sample registered with
+ * SampleSetLoader::registerBuiltIn.
+ */
+struct SampleMapping
+{
+    static constexpr const char* builtInPrefix = "builtin:";
+
+    juce::String source;
+    int lowNote = 60;
+    int highNote = 60;
+    int rootNote = 60;
+};
+
+/**
+ * One decoded sample, ready to play. Short samples are held whole, normalised and resampled to the
+ * set's rate. Long ones keep only a head in memory, at the file's own rate; a SampleStream reads the
+ * rest while the head plays.
+ */
+struct SampleSlot
+{
+    bool isStreamed() const { return streamSource.isNotEmpty(); }
+
+    juce::AudioBuffer<float> data; // one guard sample past length, for interpolation
+    int length = 0;                // frames in data
+    juce::int64 totalLength = 0;   // frames in the whole sample, including any streamed part
+    double sampleRate = 44100.0;   // rate of data
+    float gain = 1.0f;             // normalisation still to apply; only streamed samples need it
+    int rootNote = 60;
+    juce::String streamSource;     // where the rest of a streamed sample is read from
+};
+
+/**
+ * A complete kit as the audio thread sees it. Once published a set is never modified; loading
+ * different samples or resampling for a new rate builds a new set.
+ */
+struct SampleSet
+{
+    SampleSet()
+    {
+        noteToSlot.fill(-1);
+    }
+
+    /** @return The sample mapped to a note, or nullptr if none is. */
+    const SampleSlot* getSlotForNote(int midiNote) const
+    {
+        const int slot = noteToSlot[(size_t) (midiNote & 127)];
+        return slot >= 0 ? &slots[(size_t) slot] : nullptr;
+    }
+
+    juce::uint64 generation = 0;
+    double sampleRate = 44100.0; // rate the slots were resampled to
+    std::vector<SampleSlot> slots;
+    std::array<int, 128> noteToSlot;
+};
+
+/**
+ * Loads sample kits on a background thread and hands them to the audio thread.
+ *
+ * Files are decoded, peak-normalised and resampled to the host rate on the loader thread, so none of
+ * that ever happens in processBlock. The decoded originals are kept, so when prepareToPlay changes the
+ * rate the kit is only resampled again. The finished SampleSet is published with an atomic pointer swap.
+ * Samples longer than maxInMemorySeconds only have their head loaded; see SampleStream.
+ *
+ * The audio thread picks up the current set in beginBlock and, in endBlock, reports the oldest set
+ * generation any of its voices still plays from. A replaced set is only deleted, on the loader thread,
+ * once a block that started after the swap has reported a newer oldest generation; so a set is never
+ * freed while the audio thread could still be holding it. If no audio is running, replaced sets wait
+ * until the next block or until the loader is destroyed.
+ */
+class SampleSetLoader : private juce::Thread
+{
+public:
+    static constexpr juce::uint32 kitMagic = 0x4b53454e; // "NESK"
+    static constexpr juce::uint32 kitVersion = 1;
+
+    /** Longest sample held in memory; anything longer is streamed. */
+    static constexpr double maxInMemorySeconds = 10.0;
+
+    /** Length of the head kept in memory for a streamed sample, enough to cover opening the file. */
+    static constexpr double streamHeadSeconds = 1.0;
+
+    /** Peak level samples are normalised to, about -1 dBFS. */
+    static constexpr float normalisedPeak = 0.89f;
+
+    SampleSetLoader() : juce::Thread("Sample loader")
+    {
+        formatManager.registerBasicFormats();
+    }
+
+    ~SampleSetLoader() override
+    {
+        stopThread(4000);
+        delete current.exchange(nullptr);
+    }
+
+    /**
+     * Makes an embedded sample available to kits as builtInPrefix + name. Call before loading kits
+     * that use it.
+     */
+    void registerBuiltIn(const juce::String& name, const void* data, size_t dataSize)
+    {
+        const std::lock_guard<TracedMutex> lock(requestLock);
+        builtIns.push_back({ name, data, dataSize });
+    }
+
+    /**
+     * Starts loading a kit in the background. The current kit keeps playing until the new one is ready.
+     * @param kit The samples and their note ranges.
+     */
+    void loadKit(const juce::Array<SampleMapping>& kit)
+    {
+        {
+            const std::lock_guard<TracedMutex> lock(requestLock);
+            requestedKit = kit;
+            ++requestedLoads;
+        }
+
+        requestReload();
+    }
+
+    juce::Array<SampleMapping> getKit() const
+    {
+        const std::lock_guard<TracedMutex> lock(requestLock);
+        return requestedKit;
+    }
+
+    /**
+     * Sets the rate kits are resampled to, rebuilding the current kit if it changed. Called from
+     * prepareToPlay; until the rebuild is published, voices correct the rate as they play.
+     */
+    void setTargetSampleRate(double sampleRate)
+    {
+        {
+            const std::lock_guard<TracedMutex> lock(requestLock);
+
+            if (sampleRate <= 0.0 || sampleRate == targetSampleRate)
+                return;
+
+            targetSampleRate = sampleRate;
+            ++requestedLoads;
+        }
+
+        requestReload();
+    }
+
+    /**
+     * Waits for the loader to finish every kit and rate change requested so far, e.g. before an offline
+     * render. Not for the audio thread.
+     * @param timeoutMs How long to wait at most.
+     * @return False if the loader was still busy when the time ran out.
+     */
+    bool waitUntilLoaded(int timeoutMs) const
+    {
+        const auto deadline = juce::Time::getMillisecondCounter() + (juce::uint32) timeoutMs;
+
+        while (completedLoads.load() < requestedLoads.load())
+        {
+            if (juce::Time::getMillisecondCounter() >= deadline)
+                return false;
+
+            juce::Thread::sleep(5);
+        }
+
+        return true;
+    }
+
+    //==============================================================================
+    /**
+     * Audio thread: starts a block.
+     * @return The most recently published set, or nullptr before the first kit has loaded.
+     */
+    const SampleSet* beginBlock()
+    {
+        // sequentially consistent with publish(), see reclaim()
+        audioBlock.store(audioBlock.load(std::memory_order_relaxed) + 1);
+        return current.load();
+    }
+
+    /**
+     * Opens a sample's source for streaming. Files are memory-mapped where the format allows it, so
+     * reads only touch the pages they need.
+     * @return The reader, or nullptr if the source can't be opened.
+     */
+    std::unique_ptr<juce::AudioFormatReader> createStreamReader(const juce::String& source)
+    {
+        const juce::File file(source);
+
+        if (! source.startsWith(SampleMapping::builtInPrefix) && file.existsAsFile())
+        {
+            if (auto* format = formatManager.findFormatForFileExtension(file.getFileExtension()))
+            {
+                std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped(format->createMemoryMappedReader(file));
+
+                if (mapped != nullptr && mapped->mapEntireFile())
+                    return mapped;
+            }
+        }
+
+        return createReader(source);
+    }
+
+    /**
+     * Audio thread: ends a block, reporting which sets are still in use so older ones can be freed.
+     * @param oldestGeneration The lowest generation referenced by the block's set or any voice.
+     */
+    void endBlock(juce::uint64 oldestGeneration)
+    {
+        oldestInUse.store(oldestGeneration, std::memory_order_relaxed);
+        reportedBlock.store(audioBlock.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+
+    //==============================================================================
+    /** Writes a kit description for the plugin state. */
+    static void writeKit(juce::OutputStream& out, const juce::Array<SampleMapping>& kit)
+    {
+        out.writeInt((int) kitMagic);
+        out.writeInt((int) kitVersion);
+        out.writeInt(kit.size());
+
+        for (const auto& mapping : kit)
+        {
+            out.writeString(mapping.source);
+            out.writeInt(mapping.lowNote);
+            out.writeInt(mapping.highNote);
+            out.writeInt(mapping.rootNote);
+        }
+    }
+
+    /**
+     * Reads a kit description written by writeKit.
+     * @return False if the data isn't a kit, in which case kit is left alone.
+     */
+    static bool readKit(juce::InputStream& in, juce::Array<SampleMapping>& kit)
+    {
+        if ((juce::uint32) in.readInt() != kitMagic || (juce::uint32) in.readInt() > kitVersion)
+            return false;
+
+        const int count = in.readInt();
+        if (count < 0 || count > 128)
+            return false;
+
+        juce::Array<SampleMapping> newKit;
+
+        for (int i = 0; i < count && ! in.isExhausted(); ++i)
+        {
+            SampleMapping mapping;
+            mapping.source = in.readString();
+            mapping.lowNote = juce::jlimit(0, 127, in.readInt());
+            mapping.highNote = juce::jlimit(mapping.lowNote, 127, in.readInt());
+            mapping.rootNote = juce::jlimit(0, 127, in.readInt());
+            newKit.add(mapping);
+        }
+
+        kit = newKit;
+        return true;
+    }
+
+private:
+    struct RetiredSet
+    {
+        std::unique_ptr<SampleSet> set;
+        juce::uint64 retiredDuringBlock;
+    };
+
+    /** A sample as read from its source and normalised, before resampling. */
+    struct DecodedSample
+    {
+        juce::AudioBuffer<float> audio; // resamplerPadding frames of silence past length
+        int length = 0;
+        double sampleRate = 44100.0;
+        juce::Time modified;
+    };
+
+    /** Silence kept past the end of decoded samples for the resampler's lookahead. */
+    static constexpr int resamplerPadding = 128;
+
+    struct BuiltIn
+    {
+        juce::String name;
+        const void* data;
+        size_t dataSize;
+    };
+
+    /** Wakes the loader. The request itself is made, and counted, under requestLock. */
+    void requestReload()
+    {
+        reloadRequested = true;
+
+        if (! isThreadRunning())
+            startThread();
+
+        notify();
+    }
+
+    void run() override
+    {
+        while (! threadShouldExit())
+        {
+            if (reloadRequested.exchange(false))
+            {
+                juce::Array<SampleMapping> kit;
+                double sampleRate;
+                juce::uint32 request;
+
+                // the count is read with the kit, so completing it means exactly the requests this build includes
+                {
+                    const std::lock_guard<TracedMutex> lock(requestLock);
+                    kit = requestedKit;
+                    sampleRate = targetSampleRate;
+                    request = requestedLoads.load();
+                }
+
+                auto set = build(kit, sampleRate);
+
+                if (set != nullptr)
+                    publish(std::move(set));
+
+                completedLoads = request;
+            }
+
+            reclaim();
+
+            // keep checking while old sets are waiting for the audio thread to let go of them
+            wait(retired.empty() ? -1 : 100);
+        }
+    }
+
+    std::unique_ptr<SampleSet> build(const juce::Array<SampleMapping>& kit, double sampleRate)
+    {
+        auto set = std::make_unique<SampleSet>();
+        set->sampleRate = sampleRate;
+        set->slots.reserve((size_t) kit.size());
+
+        for (const auto& mapping : kit)
+        {
+            if (threadShouldExit() || reloadRequested)
+                return nullptr; // superseded, the next request is picked up straight away
+
+            SampleSlot slot;
+            if (! decode(mapping, sampleRate, slot))
+                continue;
+
+            for (int note = mapping.lowNote; note <= mapping.highNote; ++note)
+                set->noteToSlot[(size_t) (note & 127)] = (int) set->slots.size();
+
+            set->slots.push_back(std::move(slot));
+        }
+
+        // only keep decoded originals the current kit can be resampled from
+        for (auto it = decodedSamples.begin(); it != decodedSamples.end();)
+        {
+            const bool inKit = std::any_of(kit.begin(), kit.end(), [&](const SampleMapping& m) { return m.source == it->first; });
+            it = inKit ? std::next(it) : decodedSamples.erase(it);
+        }
+
+        return set;
+    }
+
+    std::unique_ptr<juce::AudioFormatReader> createReader(const juce::String& source)
+    {
+        if (source.startsWith(SampleMapping::builtInPrefix))
+        {
+            const auto name = source.substring((int) std::strlen(SampleMapping::builtInPrefix));
+            const void* data = nullptr;
+            size_t dataSize = 0;
+
+            {
+                const std::lock_guard<TracedMutex> lock(requestLock);
+
+                for (const auto& builtIn : builtIns)
+                    if (builtIn.name == name)
+                        std::tie(data, dataSize) = std::make_tuple(builtIn.data, builtIn.dataSize);
+            }
+
+            if (data == nullptr)
+                return nullptr;
+
+            return std::unique_ptr<juce::AudioFormatReader>(
+                formatManager.createReaderFor(std::make_unique<juce::MemoryInputStream>(data, dataSize, false)));
+        }
+
+        return std::unique_ptr<juce::AudioFormatReader>(formatManager.createReaderFor(juce::File(source)));
+    }
+
+    /** Decodes, normalises and resamples one sample into a slot. */
+    bool decode(const SampleMapping& mapping, double sampleRate, SampleSlot& slot)
+    {
+        slot.rootNote = mapping.rootNote;
+
+        const auto modified = getModificationTime(mapping.source);
+        auto cached = decodedSamples.find(mapping.source);
+
+        // a rate change only has to resample, the files were decoded for the previous kit
+        if (cached != decodedSamples.end() && cached->second.modified == modified)
+        {
+            resample(cached->second, sampleRate, slot);
+            return true;
+        }
+
+        auto reader = createReader(mapping.source);
+
+        if (reader == nullptr || reader->sampleRate <= 0.0 || reader->lengthInSamples <= 0)
+            return false;
+
+        if (reader->lengthInSamples > (juce::int64) (maxInMemorySeconds * reader->sampleRate))
+            return decodeHead(*reader, mapping.source, slot);
+
+        DecodedSample decoded;
+        decoded.length = (int) reader->lengthInSamples;
+        decoded.sampleRate = reader->sampleRate;
+        decoded.modified = modified;
+
+        const int numChannels = juce::jmin(2, (int) reader->numChannels);
+        decoded.audio.setSize(numChannels, decoded.length + resamplerPadding);
+        decoded.audio.clear();
+        reader->read(&decoded.audio, 0, decoded.length, 0, true, numChannels > 1);
+
+        const float peak = decoded.audio.getMagnitude(0, decoded.length);
+        if (peak > 0.0f)
+            decoded.audio.applyGain(normalisedPeak / peak);
+
+        resample(decoded, sampleRate, slot);
+        decodedSamples[mapping.source] = std::move(decoded);
+        return true;
+    }
+
+    /**
+     * Converts a decoded sample to the set's rate with a windowed-sinc interpolator, so voices
+     * playing a note at its root can copy the data straight out.
+     */
+    static void resample(const DecodedSample& decoded, double sampleRate, SampleSlot& slot)
+    {
+        const int numChannels = decoded.audio.getNumChannels();
+        const double ratio = decoded.sampleRate / sampleRate;
+
+        slot.length = juce::jmax(1, (int) std::ceil(decoded.length / ratio));
+        slot.totalLength = slot.length;
+        slot.sampleRate = sampleRate;
+        slot.data.setSize(numChannels, slot.length + 1);
+        slot.data.clear();
+
+        constexpr int latency = (int) juce::WindowedSincInterpolator::getBaseLatency();
+        static_assert(latency < resamplerPadding, "the interpolator reads past the end of the sample");
+        float primed[latency];
+
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            const float* in = decoded.audio.getReadPointer(channel);
+
+            if (ratio == 1.0)
+            {
+                slot.data.copyFrom(channel, 0, in, decoded.length);
+                continue;
+            }
+
+            // the interpolator's output lags its input by its latency; feeding that much through
+            // first lines the resampled data up with the start of the sample
+            juce::WindowedSincInterpolator interpolator;
+            interpolator.process(1.0, in, primed, latency);
+            interpolator.process(ratio, in + latency, slot.data.getWritePointer(channel), slot.length);
+        }
+    }
+
+    static juce::Time getModificationTime(const juce::String& source)
+    {
+        if (source.startsWith(SampleMapping::builtInPrefix))
+            return {};
+
+        return juce::File(source).getLastModificationTime();
+    }
+
+    /**
+     * Loads the head of a long sample. It stays at the file's rate so the streamed part, which is
+     * read raw, carries on from it seamlessly; the voice corrects the rate as it plays.
+     */
+    bool decodeHead(juce::AudioFormatReader& reader, const juce::String& source, SampleSlot& slot)
+    {
+        const int numChannels = juce::jmin(2, (int) reader.numChannels);
+
+        // one scan of the whole file for the peak, so the streamed part can be normalised as it's read
+        juce::Range<float> levels[2];
+        reader.readMaxLevels(0, reader.lengthInSamples, levels, numChannels);
+
+        float peak = 0.0f;
+        for (int channel = 0; channel < numChannels; ++channel)
+            peak = juce::jmax(peak, std::abs(levels[channel].getStart()), std::abs(levels[channel].getEnd()));
+
+        slot.length = (int) (streamHeadSeconds * reader.sampleRate);
+        slot.totalLength = reader.lengthInSamples;
+        slot.sampleRate = reader.sampleRate;
+        slot.gain = peak > 0.0f ? normalisedPeak / peak : 1.0f;
+        slot.streamSource = source;
+        slot.data.setSize(numChannels, slot.length + 1);
+        reader.read(&slot.data, 0, slot.length + 1, 0, true, numChannels > 1);
+
+        return true;
+    }
+
+    void publish(std::unique_ptr<SampleSet> set)
+    {
+        set->generation = ++lastGeneration;
+
+        if (auto* old = current.exchange(set.release()))
+            retired.push_back({ std::unique_ptr<SampleSet>(old), audioBlock.load() });
+    }
+
+    void reclaim()
+    {
+        // a block that had already started when the set was swapped may still have picked up the old
+        // pointer without reporting it yet, so only reports from later blocks count
+        const auto reported = reportedBlock.load(std::memory_order_acquire);
+        const auto oldest = oldestInUse.load(std::memory_order_relaxed);
+
+        retired.erase(std::remove_if(retired.begin(), retired.end(),
+                                     [=](const RetiredSet& r) { return reported > r.retiredDuringBlock && r.set->generation < oldest; }),
+                      retired.end());
+    }
+
+    juce::AudioFormatManager formatManager;
+
+    mutable TracedMutex requestLock;
+    juce::Array<SampleMapping> requestedKit;
+    std::vector<BuiltIn> builtIns;
+    double targetSampleRate = 44100.0;
+    std::atomic<bool> reloadRequested { false };
+    std::atomic<juce::uint32> requestedLoads { 0 }, completedLoads { 0 };
+
+    // loader thread only
+    std::vector<RetiredSet> retired;
+    std::map<juce::String, DecodedSample> decodedSamples;
+    juce::uint64 lastGeneration = 0;
+
+    std::atomic<SampleSet*> current { nullptr };
+    std::atomic<juce::uint64> audioBlock { 0 };
+    std::atomic<juce::uint64> reportedBlock { 0 };
+    std::atomic<juce::uint64> oldestInUse { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleSetLoader)
+};
@@ -0,0 +1,213 @@
+/*
+  ==============================================================================
+
+    SampleStream.h
+    Created: 18 Oct 2026 9:02:17pm
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SampleSet.h"
+#include "AllocationTracer.h"
+
+/**
+ * Reads the part of a long sample that isn't held in memory, for one sampler voice. The voice plays
+ * the slot's in-memory head while the stream, on the sampler's I/O thread, opens the source and
+ * reads ahead into a lock-free ring buffer; by the time the head runs out the ring is full.
+ *
+ * The audio thread only ever posts requests (start or stop) and reads the ring. Each request bumps
+ * a generation number; the I/O thread acknowledges a generation once it has copied everything it
+ * needs from the slot, and marks it ready once the ring has been refilled for it, so the audio thread
+ * never reads data left over from a previous note.
+ */
+class SampleStream : public juce::TimeSliceClient
+{
+public:
+    /** Frames of read-ahead per stream; this plus the heads is all the memory long samples take. */
+    static constexpr int bufferFrames = 32768;
+    static constexpr int readChunk = 4096;
+
+    explicit SampleStream(SampleSetLoader& _loader)
+        : loader(_loader), ring(2, bufferFrames), readBuffer(2, readChunk)
+    {
+    }
+
+    //==============================================================================
+    /**
+     * Audio thread: starts streaming a slot from the end of its head.
+     * @param slot A streamed slot. It must stay alive until isIdle() returns true.
+     */
+    void start(const SampleSlot& slot)
+    {
+        request.store(&slot, std::memory_order_relaxed);
+        requestedGeneration.fetch_add(1, std::memory_order_release);
+    }
+
+    /** Audio thread: stops streaming. */
+    void stop()
+    {
+        request.store(nullptr, std::memory_order_relaxed);
+        requestedGeneration.fetch_add(1, std::memory_order_release);
+    }
+
+    /** True once the I/O thread no longer refers to the slot of any earlier request. */
+    bool isIdle() const
+    {
+        return acknowledgedGeneration.load(std::memory_order_acquire) == requestedGeneration.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Audio thread: takes streamed frames from the ring.
+     * @param left Destination for the first channel.
+     * @param right Destination for the second channel; mono sources are copied to both.
+     * @param maxFrames Most frames to take.
+     * @return Frames taken; 0 if nothing has been read for the current request yet.
+     */
+    int read(float* left, float* right, int maxFrames)
+    {
+        if (readyGeneration.load(std::memory_order_acquire) != requestedGeneration.load(std::memory_order_relaxed))
+            return 0;
+
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(maxFrames, start1, size1, start2, size2);
+
+        copyFromRing(left, right, start1, size1);
+        copyFromRing(left + size1, right + size1, start2, size2);
+
+        fifo.finishedRead(size1 + size2);
+        return size1 + size2;
+    }
+
+    /** Audio thread: counts a frame the ring couldn't supply in time. */
+    void countUnderrun()
+    {
+        underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** Frames that were played as silence because the stream fell behind. */
+    juce::uint32 getUnderruns() const
+    {
+        return underruns.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Services the stream straight away, taking the I/O lock and reading the file on the calling
+     * thread. Only for rendering offline, where waiting for disk is fine and an underrun is not;
+     * never called while rendering in real time.
+     */
+    void readNow()
+    {
+        service();
+    }
+
+    //==============================================================================
+    int useTimeSlice() override
+    {
+        return service() ? 0 : 5;
+    }
+
+private:
+    /** @return True if there is more to read right away. */
+    bool service()
+    {
+        const std::lock_guard<TracedMutex> lock(ioLock);
+
+        const auto generation = requestedGeneration.load(std::memory_order_acquire);
+
+        if (generation != servicedGeneration)
+        {
+            servicedGeneration = generation;
+            startRequest(request.load(std::memory_order_relaxed));
+
+            // nothing refers to the slot from here on
+            acknowledgedGeneration.store(generation, std::memory_order_release);
+        }
+
+        const bool more = fill();
+
+        readyGeneration.store(servicedGeneration, std::memory_order_release);
+        return more;
+    }
+
+    void startRequest(const SampleSlot* slot)
+    {
+        // the audio thread doesn't read until this generation is marked ready
+        fifo.reset();
+        readPosition = endPosition = 0;
+
+        if (slot == nullptr || slot->streamSource.isEmpty())
+            return;
+
+        if (slot->streamSource != openSource || reader == nullptr)
+        {
+            reader = loader.createStreamReader(slot->streamSource);
+            openSource = slot->streamSource;
+        }
+
+        if (reader == nullptr)
+            return;
+
+        readPosition = slot->length;
+        endPosition = juce::jmin(slot->totalLength, reader->lengthInSamples);
+        gain = slot->gain;
+    }
+
+    bool fill()
+    {
+        const int numFrames = (int) juce::jmin((juce::int64) juce::jmin(fifo.getFreeSpace(), readChunk), endPosition - readPosition);
+
+        if (reader == nullptr || numFrames <= 0)
+            return false;
+
+        reader->read(&readBuffer, 0, numFrames, readPosition, true, true);
+        readBuffer.applyGain(0, numFrames, gain);
+        readPosition += numFrames;
+
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(numFrames, start1, size1, start2, size2);
+
+        for (int channel = 0; channel < 2; ++channel)
+        {
+            ring.copyFrom(channel, start1, readBuffer, channel, 0, size1);
+            ring.copyFrom(channel, start2, readBuffer, channel, size1, size2);
+        }
+
+        fifo.finishedWrite(size1 + size2);
+        return readPosition < endPosition && fifo.getFreeSpace() > 0;
+    }
+
+    void copyFromRing(float* left, float* right, int start, int numFrames)
+    {
+        if (numFrames <= 0)
+            return;
+
+        juce::FloatVectorOperations::copy(left, ring.getReadPointer(0, start), numFrames);
+        juce::FloatVectorOperations::copy(right, ring.getReadPointer(1, start), numFrames);
+    }
+
+    SampleSetLoader& loader;
+
+    // shared between the audio thread and the I/O thread
+    juce::AbstractFifo fifo { bufferFrames };
+    juce::AudioBuffer<float> ring;
+    std::atomic<const SampleSlot*> request { nullptr };
+    std::atomic<juce::uint32> requestedGeneration { 0 };
+    std::atomic<juce::uint32> acknowledgedGeneration { 0 };
+    std::atomic<juce::uint32> readyGeneration { 0 };
+    std::atomic<juce::uint32> underruns { 0 };
+
+    // I/O side
+    TracedMutex ioLock;
+    juce::uint32 servicedGeneration = 0;
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    juce::String openSource;
+    juce::AudioBuffer<float> readBuffer;
+    juce::int64 readPosition = 0, endPosition = 0;
+    float gain = 1.0f;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleStream)
+};
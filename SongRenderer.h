@@ -0,0 +1,429 @@
+/*
+  ==============================================================================
+
+    SongRenderer.h
+    Created: 19 Oct 2026 2:48:37am
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+/**
+ * Renders a long song offline on every core, in chunks, with output bit-identical to rendering it
+ * serially at the same block size (RenderCheck::render with { blockSize } hashes the same).
+ *
+ * Every chunk but the first starts speculatively from one checkpoint: a fresh engine that has
+ * rendered a short stretch of silence, moved to the chunk's start. That is exactly the state the
+ * serial render reaches once every voice, arpeggiator step, filter and reverb tail has died away,
+ * which a full serial pre-pass could only find out by doing all the work of the render itself.
+ *
+ * How long that takes depends on the patch, mostly on its release and reverb, so it is measured once
+ * up front: the checkpoint's engine plays a few notes and counts the samples until its state is the
+ * checkpoint's again. A fast pre-pass then reads only the MIDI and cuts the song where nothing is held
+ * and no note has ended for at least that long (and minimumGapSeconds), on a block boundary, aiming
+ * for a couple of chunks per core. A patch that doesn't settle within maxSettleSeconds is rendered as
+ * one chunk, without any speculative work.
+ *
+ * The chunks are checked in order afterwards: a chunk stands if its starting checkpoint equals the
+ * one its predecessor ended with. If not (a louder tail than the measurement's, a pitch wheel left
+ * bent) the chunk is rendered again by carrying on with its predecessor's engine, so the result is
+ * always the serial render's and only the speed depends on the gaps. The engines are kept until their
+ * chunks are checked; getStatistics() says how many had to be rendered again.
+ *
+ * The engines are headless: they don't scan the preset folder or start timers, so the renderer runs
+ * from a command-line host as well as from a background thread of the plugin.
+ */
+class SongRenderer
+{
+public:
+    struct Settings
+    {
+        double sampleRate = 48000.0;
+        int blockSize = 512;
+
+        double minimumGapSeconds = 2.0; // quiet needed before a chunk may start, if the patch settles sooner
+        int chunksPerCore = 2;          // more chunks even out the work, but start more engines
+    };
+
+    struct Statistics
+    {
+        int numChunks = 0;
+        int chunksRerendered = 0; // chunks whose speculative start turned out wrong
+        double gapSeconds = 0.0;  // quiet the song was cut at, 0 if it wasn't cut
+    };
+
+    /**
+     * Renders the song, blocking until it is done or cancelled.
+     * @param state A PackedState blob, or empty for the default parameters.
+     * @param song The MIDI to play, with sample positions from the start of the render.
+     * @param numSamples Length of the render.
+     * @param settings Sample rate, block size and how to cut the song.
+     * @param output Receives the rendered stereo audio.
+     * @return False if cancelled, or if the preset's sample kit didn't load in time.
+     */
+    bool render(const juce::MemoryBlock& state, const juce::MidiBuffer& song, int numSamples, const Settings& settings,
+                juce::AudioBuffer<float>& output)
+    {
+        output.setSize(2, juce::jmax(0, numSamples));
+        output.clear();
+
+        statistics = {};
+        cancelled = false;
+
+        if (numSamples <= 0)
+            return true;
+
+        // worth measuring the patch only if the song can be cut at all
+        const int minimumGapSamples = (int) (settings.minimumGapSeconds * settings.sampleRate);
+        findChunks(song, numSamples, settings, minimumGapSamples);
+
+        // the checkpoint every chunk after the first starts from
+        templateState.reset();
+        if (chunks.size() > 1)
+        {
+            auto engine = createEngine(state, settings);
+            if (engine == nullptr)
+                return false;
+
+            const int blockSize = juce::jmax(1, settings.blockSize);
+            const int warmupSamples = juce::jmax(blockSize, (int) std::ceil(warmupSeconds * settings.sampleRate));
+            juce::AudioBuffer<float> silence(2, blockSize);
+            juce::MidiBuffer noMidi;
+            int templatePosition = 0;
+
+            for (; templatePosition < warmupSamples; templatePosition += blockSize)
+            {
+                silence.clear();
+                engine->processBlock(silence, noMidi);
+            }
+
+            engine->saveDspState(templateState);
+
+            // a speculative start before the patch has settled is bound to be wrong, so cut only where it has
+            const int settleSamples = measureSettleSamples(*engine, templatePosition, settings);
+            const int gapSamples = settleSamples < 0 ? numSamples : juce::jmax(minimumGapSamples, settleSamples + settleSamples / 4);
+            findChunks(song, numSamples, settings, gapSamples);
+
+            if (chunks.size() > 1)
+                statistics.gapSeconds = gapSamples / settings.sampleRate;
+        }
+
+        statistics.numChunks = chunks.size();
+
+        nextChunk = 0;
+
+        const int numWorkers = juce::jmin(juce::SystemStats::getNumCpus(), chunks.size());
+        juce::ThreadPool pool(numWorkers);
+        juce::OwnedArray<Worker> workers;
+
+        for (int i = 0; i < numWorkers; ++i)
+            pool.addJob(workers.add(new Worker(*this, state, song, settings, output)), false);
+
+        for (auto* worker : workers)
+            pool.waitForJobToFinish(worker, -1);
+
+        // stitch: each chunk must start where the one before it ended
+        for (int i = 1; i < chunks.size() && ! cancelled; ++i)
+        {
+            auto& previous = *chunks[i - 1];
+            auto& chunk = *chunks[i];
+
+            if (! chunk.speculative || chunk.startState != previous.endState)
+            {
+                chunk.engine = std::move(previous.engine);
+                renderChunk(*chunk.engine, chunk, song, settings, output);
+                chunk.engine->saveDspState(chunk.endState);
+                ++statistics.chunksRerendered;
+            }
+
+            previous.engine.reset();
+        }
+
+        chunks.clear();
+        return ! cancelled;
+    }
+
+    /** Stops a render in progress; blocks already being rendered are finished first. */
+    void cancel()
+    {
+        cancelled = true;
+    }
+
+    /** How the last render was cut, and how much of it had to be rendered twice. */
+    Statistics getStatistics() const
+    {
+        return statistics;
+    }
+
+private:
+    static constexpr double warmupSeconds = 0.05;   // longer than the reverb's parameter ramps
+    static constexpr double probeHoldSeconds = 0.25; // how long the settling measurement's notes are held
+    static constexpr double maxSettleSeconds = 20.0;
+
+    struct Chunk
+    {
+        int start = 0, end = 0;
+        bool speculative = false; // started from the template rather than the render before it
+
+        juce::MemoryBlock startState, endState;
+        std::unique_ptr<SynthExampleAudioProcessor> engine;
+    };
+
+    /** One thread, rendering chunks until there are none left. */
+    class Worker : public juce::ThreadPoolJob
+    {
+    public:
+        Worker(SongRenderer& r, const juce::MemoryBlock& st, const juce::MidiBuffer& m, const Settings& s,
+               juce::AudioBuffer<float>& o)
+            : juce::ThreadPoolJob("Song render worker"), renderer(r), state(st), song(m), settings(s), output(o)
+        {
+        }
+
+        JobStatus runJob() override
+        {
+            for (int index = renderer.nextChunk++; index < renderer.chunks.size(); index = renderer.nextChunk++)
+            {
+                if (shouldExit() || renderer.cancelled)
+                    break;
+
+                // built here so the engine's memory is first touched by the thread that uses it
+                auto& chunk = *renderer.chunks[index];
+                auto engine = createEngine(state, settings);
+
+                // one chunk that can't be rendered fails the whole song
+                if (engine == nullptr)
+                {
+                    renderer.cancelled = true;
+                    break;
+                }
+
+                if (index > 0)
+                {
+                    const auto& checkpoint = renderer.templateState;
+                    if (! engine->restoreDspState(checkpoint.getData(), (int) checkpoint.getSize()))
+                        continue; // left for the stitching pass
+
+                    engine->setRenderPosition(chunk.start);
+                    engine->saveDspState(chunk.startState);
+                    chunk.speculative = true;
+                }
+
+                renderChunk(*engine, chunk, song, settings, output);
+                engine->saveDspState(chunk.endState);
+                chunk.engine = std::move(engine);
+            }
+
+            return jobHasFinished;
+        }
+
+    private:
+        SongRenderer& renderer;
+        const juce::MemoryBlock& state;
+        const juce::MidiBuffer& song;
+        const Settings& settings;
+        juce::AudioBuffer<float>& output;
+    };
+
+    /** A prepared, headless offline engine, or nullptr if its sample kit didn't load in time. */
+    static std::unique_ptr<SynthExampleAudioProcessor> createEngine(const juce::MemoryBlock& state, const Settings& settings)
+    {
+        auto engine = std::make_unique<SynthExampleAudioProcessor>(true);
+        engine->setNonRealtime(true);
+        engine->setRateAndBufferSizeDetails(settings.sampleRate, settings.blockSize);
+
+        if (state.getSize() > 0)
+            engine->setStateInformation(state.getData(), (int) state.getSize());
+
+        engine->prepareToPlay(settings.sampleRate, settings.blockSize);
+
+        if (! engine->waitForSampleKit(10000))
+            return nullptr;
+
+        return engine;
+    }
+
+    /** Renders a chunk's blocks, split as the serial render splits them, into its part of the output. */
+    static void renderChunk(SynthExampleAudioProcessor& engine, const Chunk& chunk, const juce::MidiBuffer& song,
+                            const Settings& settings, juce::AudioBuffer<float>& output)
+    {
+        juce::MidiBuffer blockMidi;
+
+        for (int position = chunk.start; position < chunk.end;)
+        {
+            const int length = juce::jmin(juce::jmax(1, settings.blockSize), chunk.end - position);
+            juce::AudioBuffer<float> block(output.getArrayOfWritePointers(), 2, position, length);
+
+            block.clear();
+            blockMidi.clear();
+            blockMidi.addEvents(song, position, length, -position);
+
+            engine.processBlock(block, blockMidi);
+            position += length;
+        }
+    }
+
+    /**
+     * How long after a note off the patch takes to be back in the checkpoint's state: every voice and
+     * arpeggiator step finished and every filter and reverb tail flushed to zero, which the mixer's
+     * filters and the reverb's undenormalising do within seconds for all but the largest rooms.
+     * @param engine The checkpoint's engine, just after the checkpoint was saved.
+     * @param templatePosition Where the checkpoint was saved.
+     * @param settings Sample rate and block size.
+     * @return Samples from the note off, or -1 if the patch hadn't settled after maxSettleSeconds.
+     */
+    int measureSettleSamples(SynthExampleAudioProcessor& engine, int templatePosition, const Settings& settings) const
+    {
+        const int blockSize = juce::jmax(1, settings.blockSize);
+        const int releaseAt = (int) (probeHoldSeconds * settings.sampleRate);
+        const int maxSamples = releaseAt + (int) (maxSettleSeconds * settings.sampleRate);
+        const int checkEvery = juce::jmax(1, (int) (0.05 * settings.sampleRate) / blockSize);
+
+        // a chord across the melodic range and the drum kit, at full velocity
+        juce::MidiBuffer probe;
+        for (auto note : { 48, 53, 60, 64 })
+        {
+            probe.addEvent(juce::MidiMessage::noteOn(1, note, (juce::uint8) 127), 0);
+            probe.addEvent(juce::MidiMessage::noteOff(1, note), releaseAt);
+        }
+
+        juce::AudioBuffer<float> block(2, blockSize);
+        juce::MidiBuffer blockMidi;
+        juce::MemoryBlock settled;
+
+        for (int rendered = 0, count = 1; rendered < maxSamples && ! cancelled; ++count)
+        {
+            block.clear();
+            blockMidi.clear();
+            blockMidi.addEvents(probe, rendered, blockSize, -rendered);
+
+            engine.processBlock(block, blockMidi);
+            rendered += blockSize;
+
+            if (rendered <= releaseAt || count % checkEvery != 0 || engine.hasActiveVoices())
+                continue;
+
+            // compared at the checkpoint's position, the one thing bound to differ
+            engine.setRenderPosition(templatePosition);
+            engine.saveDspState(settled);
+            engine.setRenderPosition(templatePosition + rendered);
+
+            if (settled == templateState)
+                return rendered - releaseAt;
+        }
+
+        return -1;
+    }
+
+    /** The pre-pass: cuts the song into chunks at quiet, block-aligned places in the MIDI. */
+    void findChunks(const juce::MidiBuffer& song, int numSamples, const Settings& settings, int gapSamples)
+    {
+        const int blockSize = juce::jmax(1, settings.blockSize);
+        const int targetChunks = juce::SystemStats::getNumCpus() * juce::jmax(1, settings.chunksPerCore);
+        const int targetSamples = juce::jmax(blockSize, numSamples / targetChunks);
+
+        std::array<bool, 16 * 128> held {};
+        int numHeld = 0;
+        juce::uint32 sustained = 0, sostenuto = 0; // a bit per channel
+        int quietSince = 0;
+
+        chunks.clear();
+        chunks.add(new Chunk());
+
+        // places boundaries in the quiet before a position, as many as fit
+        auto cutBefore = [&](int position)
+        {
+            if (numHeld > 0 || sustained != 0 || sostenuto != 0)
+                return;
+
+            for (;;)
+            {
+                const int earliest = juce::jmax(quietSince + gapSamples, chunks.getLast()->start + targetSamples);
+                const int boundary = ((earliest + blockSize - 1) / blockSize) * blockSize;
+
+                if (boundary > position)
+                    return;
+
+                chunks.getLast()->end = boundary;
+                chunks.add(new Chunk());
+                chunks.getLast()->start = boundary;
+            }
+        };
+
+        for (const auto metadata : song)
+        {
+            if (metadata.samplePosition >= numSamples)
+                break;
+
+            cutBefore(metadata.samplePosition);
+
+            const auto message = metadata.getMessage();
+            const int channel = message.getChannel() - 1;
+
+            if (channel < 0)
+                continue;
+
+            const auto bit = 1u << channel;
+
+            if (message.isNoteOn())
+            {
+                auto& note = held[(size_t) (channel * 128 + message.getNoteNumber())];
+                numHeld += note ? 0 : 1;
+                note = true;
+            }
+            else if (message.isNoteOff())
+            {
+                auto& note = held[(size_t) (channel * 128 + message.getNoteNumber())];
+                numHeld -= note ? 1 : 0;
+                note = false;
+                quietSince = metadata.samplePosition;
+            }
+            else if (message.isSustainPedalOn())
+            {
+                sustained |= bit;
+            }
+            else if (message.isSostenutoPedalOn())
+            {
+                sostenuto |= bit;
+            }
+            else if (message.isSustainPedalOff())
+            {
+                sustained &= ~bit;
+                quietSince = metadata.samplePosition;
+            }
+            else if (message.isSostenutoPedalOff())
+            {
+                sostenuto &= ~bit;
+                quietSince = metadata.samplePosition;
+            }
+            else if (message.isAllNotesOff() || message.isAllSoundOff())
+            {
+                for (int note = 0; note < 128; ++note)
+                {
+                    numHeld -= held[(size_t) (channel * 128 + note)] ? 1 : 0;
+                    held[(size_t) (channel * 128 + note)] = false;
+                }
+
+                sustained &= ~bit;
+                sostenuto &= ~bit;
+                quietSince = metadata.samplePosition;
+            }
+        }
+
+        cutBefore(numSamples - 1);
+        chunks.getLast()->end = numSamples;
+    }
+
+    juce::OwnedArray<Chunk> chunks; // each written only by the worker that rendered it, until stitching
+    juce::MemoryBlock templateState;
+    Statistics statistics;
+
+    std::atomic<int> nextChunk { 0 };
+    std::atomic<bool> cancelled { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SongRenderer)
+};
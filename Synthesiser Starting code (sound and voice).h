@@ -10,382 +10,1356 @@
 #pragma once
 #include <JuceHeader.h>
 #include "Basic Oscillator Class.h"
+#include "FrameSequencer.h"
+#include "PitchTables.h"
+#include "BatchedSynthesiser.h"
+#include "NesMixer.h"
+#include "NoteRenderCache.h"
+#include "TransportLFO.h"
 
 
 // ===========================
 // ===========================
 // SOUND
+
+/** Choices of the mode parameter. Only ever append, presets and automation store the index. */
+enum ChannelMode { bassMode, pulseMode, noiseMode, vrc6PulseMode, vrc6SawMode, n163Mode };
+
+/**
+ * One sound per kind of channel. NesSynthesiser::noteOn picks one from the mode parameter as each note
+ * starts, so noise notes go to drum voices and every other mode, expansion chips included, to melodic
+ * voices. Both apply to every note: a note off then finds its voice whatever the mode is by then.
+ */
 class BitCrusherSound : public juce::SynthesiserSound
 {
 public:
+    enum class Channel { melodic, noise };
+
+    explicit BitCrusherSound(Channel _channel) : channel(_channel) {}
+
    bool appliesToNote      (int) override      { return true; }
    //--------------------------------------------------------------------------
    bool appliesToChannel   (int) override      { return true; }
+
+   const Channel channel;
 };
 
 // =================================
 // =================================
-// Synthesiser Voice - your synth code goes in here
+// Shared voice resources
 
-/*!
-@class YourSynthVoice
-@abstract struct defining the DSP associated with a specific voice.
-@discussion multiple YourSynthVoice objects will be created by the Synthesiser so that it can be played polyphicially
+/**
+ * Coefficients of the noise channel's drum filters. They only depend on the sample rate, so they are
+ * built once in prepareToPlay for every drum and shared by all drum voices; each voice only keeps the
+ * filter state.
+ */
+struct DrumFilterBank
+{
+    enum Drum { hat, snare, numDrums };
 
-@namespace none
-@updated 2019-06-18
-*/
-class BitCrusherVoice : public juce::SynthesiserVoice
+    /** Rebuilds the coefficients, unless they are already for this sample rate. */
+    void prepare(double sampleRate)
+    {
+        if (sampleRate <= 0.0 || sampleRate == preparedRate)
+            return;
+
+        coefficients[hat] = juce::IIRCoefficients::makeHighPass(sampleRate, 7000);      // high-pass hi-hat
+        coefficients[snare] = juce::IIRCoefficients::makeBandPass(sampleRate, 2000, 1); // band-pass snare
+        preparedRate = sampleRate;
+    }
+
+    juce::IIRCoefficients coefficients[numDrums];
+    double preparedRate = 0.0;
+};
+
+/**
+ * Everything voices share rather than carry: the pitch tables, the expansion chip waveforms, the drum
+ * filter coefficients and the scratch buffers voices render a run into. Voices are rendered one after
+ * another on the audio thread, so a single set of scratch buffers serves all of them.
+ */
+struct VoiceResources
+{
+    static constexpr int maxChunk = 256;
+
+    /** Rebuilds the rate-dependent tables. Cached notes were rendered at the old rate, so they go too. */
+    void prepare(double sampleRate)
+    {
+        timerTables.prepare(sampleRate);
+        expansionTables.prepare(sampleRate);
+        drumFilters.prepare(sampleRate);
+        renderCache.clear();
+    }
+
+    NesTimerTables timerTables;
+    ExpansionTables expansionTables;
+    DrumFilterBank drumFilters;
+    NoteRenderCache renderCache;
+
+    /** N163 channels the chip is serving this block; 1 unless multiplexing is emulated. Set by the synth. */
+    int n163Channels = 1;
+
+    /** Samples rendered since the synth was prepared, up to the start of this block. Set by the synth. */
+    juce::int64 blockStart = 0;
+
+    /** The host's position at the start of the block, for the transport-locked LFO. Set by the synth. */
+    TransportPosition transport;
+    TransportLFO transportLFO;
+
+    float lfoBlock[maxChunk] = {};
+    float voiceBlock[maxChunk] = {};
+};
+
+// =================================
+// =================================
+// Synthesiser Voices - your synth code goes in here
+
+/**
+ * What melodic and drum voices have in common: an envelope evaluated on frame sequencer ticks, with the
+ * audio rendered in runs between ticks at a held gain. Subclasses provide the tick and the run.
+ *
+ * Members are ordered so the state the render loop touches comes first and configuration read only at
+ * note on comes last.
+ */
+class NesVoice : public BatchedVoice
 {
 public:
-    BitCrusherVoice() {
-        
-        sinLFO.setSampleRate(getSampleRate());
-        triLFO.setSampleRate(getSampleRate());
-        squareLFO.setSampleRate(getSampleRate());
-        pulse1.setSampleRate(getSampleRate());
-        pulse2.setSampleRate(getSampleRate());
-        bass.setSampleRate(getSampleRate());
-        
-        juce::ADSR::Parameters snareParams;
-        snareParams.attack = 0.01;  // Very fast attack
-        snareParams.decay = 0.15;   // Quick decay
-        snareParams.sustain = 0.0;  // No sustain
-        snareParams.release = 0.01; // Quick release
-        envSnare.setParameters(snareParams);
-
-
-        juce::ADSR::Parameters hatParams;
-        hatParams.attack = 0.01;  // Very fast attack
-        hatParams.decay = 0.08;   // Extremely quick decay
-        hatParams.sustain = 0.0;  // No sustain
-        hatParams.release = 0.01; // Quick release
-        envHat.setParameters(hatParams);
-        
-        
-        // Setup high-hat filter as a high-pass filter
-
-        highHatFilter.setCoefficients(juce::IIRCoefficients::makeHighPass(getSampleRate(), 7000));
-        highHatFilter.reset();
-
-        // Setup snare filter as a band-pass filter
-        snareFilter.setCoefficients(juce::IIRCoefficients::makeBandPass(getSampleRate(), 2000, 1));
-        snareFilter.reset();
-        
-
-        
-        
-    }
-    
-    //--------------------------------------------------------------------------
-    /**
-     What should be done when a note starts
-     
-     @param midiNoteNumber
-     @param velocity
-     @param SynthesiserSound unused variable
-     @param / unused variable
-     */
-    
-    void setParametersFromAPVTS(juce::AudioProcessorValueTreeState& apvts) {
-        
+    void setParametersFromAPVTS(juce::AudioProcessorValueTreeState& apvts)
+    {
         attackParam = apvts.getRawParameterValue("attack");
         decayParam = apvts.getRawParameterValue("decay");
         sustainParam = apvts.getRawParameterValue("sustain");
         releaseParam = apvts.getRawParameterValue("release");
-        
-        bitDepth = apvts.getRawParameterValue("bitDepth");
+
         rateDivide = apvts.getRawParameterValue("rateDivide");
-        noiseAmount = apvts.getRawParameterValue("noiseAmount");
-        
+        modeParam = apvts.getRawParameterValue("mode");
+
+        setChannelParameters(apvts);
+    }
+
+    /**
+     * Shares the synth's tables and scratch buffers with this voice.
+     * @param _resources Owned by the synthesiser, rebuilt whenever the sample rate changes.
+     */
+    void setResources(VoiceResources* _resources)
+    {
+        resources = _resources;
+    }
+
+    void setCurrentPlaybackSampleRate(double newRate) override
+    {
+        juce::SynthesiserVoice::setCurrentPlaybackSampleRate(newRate);
+
+        if (newRate <= 0.0)
+            return;
+
+        frameClock.setSampleRate(newRate);
+        sampleRateChanged(newRate);
+    }
+
+protected:
+    /** Picks up the parameters only this kind of voice uses. */
+    virtual void setChannelParameters(juce::AudioProcessorValueTreeState&) {}
+
+    virtual void sampleRateChanged(double) {}
+
+    /**
+     * Quarter-frame update: steps envelopes and counters and latches the gain for the next run.
+     * @param halfFrame True if this quarter frame is also a half frame.
+     */
+    virtual void clockFrame(bool halfFrame) = 0;
+
+    /** Renders samples between two frame sequencer ticks, where the gain is constant. */
+    virtual void renderRun(juce::AudioSampleBuffer& outputBuffer, int startSample, int numSamples) = 0;
+
+    /**
+     * Renders a stretch of the block between MIDI events.
+     * @param outputBuffer The synth's mono mixer buses.
+     * @param startSample The starting sample index.
+     * @param numSamples The number of samples to render.
+     */
+    void renderVoice(juce::AudioSampleBuffer& outputBuffer, int startSample, int numSamples) override
+    {
+        const int endSample = startSample + numSamples;
+        int sampleIndex = startSample;
+
+        while (playing && sampleIndex < endSample)
+        {
+            // envelopes and counters only move on frame sequencer ticks
+            if (frameClock.getSamplesUntilTick() == 0)
+            {
+                clockFrame(frameClock.tick());
+                continue;
+            }
+
+            // render up to the next tick with the gain held, in runs that fit the scratch buffers
+            const int runLength = juce::jmin(endSample - sampleIndex, frameClock.getSamplesUntilTick(), VoiceResources::maxChunk);
+            renderRun(outputBuffer, sampleIndex, runLength);
+            frameClock.advance(runLength);
+            sampleIndex += runLength;
+        }
+    }
+
+    /** Starts the envelope from the ADSR parameters and restarts the frame sequence. */
+    void startEnvelope()
+    {
+        //set all env params, they are evaluated by the frame sequencer from here on
+        env.setParameters(*attackParam, *decayParam, *sustainParam, *releaseParam);
+        env.noteOn();
+        frameClock.reset();
+        heldOutput = 0.0f;
+    }
+
+    /**
+     * Adds a rendered run to the voice's mixer bus, holding samples for the rate division. The groups
+     * of held samples are counted from the start of playback, not of the block, so they fall on the same
+     * samples whatever size the blocks are; a note starting inside a group is silent until the next one.
+     * @param buses The synth's mono buses, one channel per NesMixer::Bus.
+     * @param startSample Position of the run in the buffer.
+     * @param samples The rendered run.
+     * @param numSamples Length of the run.
+     */
+    void addToOutput(juce::AudioSampleBuffer& buses, int startSample, const float* samples, int numSamples)
+    {
+        const int divide = juce::jmax(1, static_cast<int>(*rateDivide));
+        float* out = buses.getWritePointer(bus) + startSample;
+
+        if (divide == 1)
+        {
+            juce::FloatVectorOperations::add(out, samples, numSamples);
+            return;
+        }
+
+        // Sample rate division processing
+        int count = (int) ((resources->blockStart + startSample) % divide);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            if (count == 0)
+                heldOutput = samples[i];
+
+            out[i] += heldOutput;
+
+            if (++count == divide)
+                count = 0;
+        }
+    }
+
+    // hot: read on every run
+    /// Should the voice be playing?
+    bool playing = false;
+    float gain = 0.0f;
+    float heldOutput = 0.0f; // the rate division's held sample
+    int bus = NesMixer::tndBus;
+    FrameSequencer frameClock;
+    EnvelopeUnit env;
+    VoiceResources* resources = nullptr;
+
+    // cold: read at note on
+    std::atomic<float>* rateDivide = nullptr;
+    std::atomic<float>* modeParam = nullptr;
+
+    std::atomic<float>* attackParam = nullptr;
+    std::atomic<float>* decayParam = nullptr;
+    std::atomic<float>* sustainParam = nullptr;
+    std::atomic<float>* releaseParam = nullptr;
+};
+
+//==============================================================================
+/**
+ * Bass (triangle) and pulse voices, plus the expansion chip channels: VRC6 pulse and sawtooth and
+ * N163 wavetable, which all play through one WavetableOsc over the shared ExpansionTables. Carries the
+ * oscillators, LFOs, sweeps and bends; nothing to do with noise.
+ */
+class MelodicVoice : public NesVoice
+{
+public:
+    /** True while the voice is sounding an N163 channel; the synth counts these for multiplexing. */
+    bool isPlayingN163() const
+    {
+        return playing && mode == n163Mode;
+    }
+
+    /**
+     * Applies the bitcrushing effect to the input sample.
+     * @param sample The input sample to be processed.
+     * @param lfoValue The value of the LFO used for modulating bit depth.
+     * @return The bitcrushed output sample.
+     */
+    float bitcrushing(float sample, float lfoValue)
+    {
+        // Calculate the modulated bit depth using the LFO value
+        float modulatedBitDepth = *bitDepth + lfoValue * (*bitDepthLFOAmount);
+
+        // Ensure the modulated bit depth stays within a valid range
+        modulatedBitDepth = juce::jlimit(1.0f, 24.0f, modulatedBitDepth);
+
+        // Calculate the bit depth power
+        float bitDepthPow = powf(2.0f, modulatedBitDepth) - 1.0f;
+
+        // Apply bitcrushing and normalize the output sample
+        return floorf(sample * bitDepthPow + 0.5f) / bitDepthPow;
+    }
+
+    /**
+     * Bend of the MPE zone's master channel, which moves every note in the zone.
+     * @param semitones Bend amount in semitones.
+     */
+    void setZoneBend(float semitones) {
+        postControl(zoneBendControl, semitones);
+    }
+
+    /** The MPE zone bend is the only thing a note leaves behind for the next. */
+    void saveState(juce::OutputStream& out) const override
+    {
+        out.writeFloat(zoneBend);
+    }
+
+    void restoreState(juce::InputStream& in) override
+    {
+        zoneBend = in.readFloat();
+    }
+
+    /**
+     Can this voice play a sound
+
+     @param sound a juce::SynthesiserSound* base class pointer
+     @return true for the melodic channels' sound
+     */
+    bool canPlaySound (juce::SynthesiserSound* sound) override
+    {
+        auto* nesSound = dynamic_cast<BitCrusherSound*> (sound);
+        return nesSound != nullptr && nesSound->channel == BitCrusherSound::Channel::melodic;
+    }
+
+protected:
+    void setChannelParameters(juce::AudioProcessorValueTreeState& apvts) override
+    {
+        bitDepth = apvts.getRawParameterValue("bitDepth");
+
         pulseWidth1Choice = apvts.getRawParameterValue("pulseWidth1");
         pulseWidth2Choice = apvts.getRawParameterValue("pulseWidth2");
         pitchOffset = apvts.getRawParameterValue("pitchOffset");
-        
-        modeParam = apvts.getRawParameterValue("mode");
-        
+
+        sweepEnabled = apvts.getRawParameterValue("sweepEnabled");
+        sweepPeriod = apvts.getRawParameterValue("sweepPeriod");
+        sweepShift = apvts.getRawParameterValue("sweepShift");
+        sweepNegate = apvts.getRawParameterValue("sweepNegate");
+
+        bendRange = apvts.getRawParameterValue("bendRange");
+        mpeEnabled = apvts.getRawParameterValue("mpeEnabled");
+        mpeBendRange = apvts.getRawParameterValue("mpeBendRange");
+
+        vrc6Duty = apvts.getRawParameterValue("vrc6Duty");
+        n163Wave = apvts.getRawParameterValue("n163Wave");
+
+        renderCacheEnabled = apvts.getRawParameterValue("renderCache");
+
         bitDepthLFOAmount = apvts.getRawParameterValue("bitDepthLFOAmount");
         LFORate = apvts.getRawParameterValue("LFORate");
         typeLFO = apvts.getRawParameterValue("typeLFO");
-        
+        lfoSync = apvts.getRawParameterValue("lfoSync");
+    }
+
+    void sampleRateChanged(double newRate) override
+    {
+        sinLFO.setSampleRate(newRate);
+        triLFO.setSampleRate(newRate);
+        squareLFO.setSampleRate(newRate);
+        pulse1.setSampleRate(newRate);
+        pulse2.setSampleRate(newRate);
+        bass.setSampleRate(newRate);
+        expansion.setSampleRate(newRate);
     }
-    
-    
+
     /**
      * Starts a note.
      * @param midiNoteNumber The MIDI note number of the note to start.
      * @param velocity The velocity of the note.
      * @param sound Pointer to the SynthesiserSound object.
-     * @param currentPitchWheelPosition Unused parameter.
+     * @param currentPitchWheelPosition Pitch wheel position of the note's channel.
      */
-    void startNote (int midiNoteNumber, float velocity, juce::SynthesiserSound*, int /*currentPitchWheelPosition*/) override
+    void noteStarted (int midiNoteNumber, float, juce::SynthesiserSound*, int currentPitchWheelPosition) override
     {
         playing = true;
-        
+        mode = (int) modeParam->load();
+        if (mode == noiseMode)
+            mode = pulseMode; // noise notes belong to the drum voices, never expected here
+
+        bus = mode == bassMode ? NesMixer::tndBus : (mode == pulseMode ? NesMixer::pulseBus : NesMixer::expansionBus);
+
         // set and update pulse width params
-        
+
         float pulseWidth1Percent = (*pulseWidth1Choice == 0) ? 0.125f : ((*pulseWidth1Choice == 1) ? 0.25f : 0.5f);
         float pulseWidth2Percent = (*pulseWidth2Choice == 0) ? 0.125f : ((*pulseWidth2Choice == 1) ? 0.25f : 0.5f);
-        
-        float freq = juce::MidiMessage::getMidiNoteInHertz(midiNoteNumber);
-        float pitchOffsetFactor = std::pow(2.0f, (*pitchOffset / 12.0f));  // Calculate pitch offset
-        
-        
-        //set all env params
-        env.setSampleRate(getSampleRate());
-        juce::ADSR::Parameters envParams;
-        envParams.attack = *attackParam;
-        envParams.decay = *decayParam;
-        envParams.sustain = *sustainParam;
-        envParams.release = *releaseParam;
-        env.setParameters(envParams);
-        env.noteOn();
-        envHat.noteOn();
-        envSnare.noteOn();
-        
-        
-        
-        
-        //allow for pitch off set and set pulse widths
-        if (modeParam->load() == 0) {
-            
-            bass.setFrequency(freq * pitchOffsetFactor);
-        } else {
-            
-            pulse1.setFrequency(freq * pitchOffsetFactor);
-            pulse2.setFrequency(freq * pitchOffsetFactor);
-            
+
+        // pitch is the channel's timer period (11-bit on the 2A03, 12-bit on the VRC6) moved by the pitch
+        // offset; the N163 takes a frequency register instead
+        const auto& timerTables = resources->timerTables;
+        const auto& expansionTables = resources->expansionTables;
+        const float offsetRatio = FastExp2::semitonesToRatio(*pitchOffset);
+
+        switch (mode)
+        {
+            case bassMode:
+                basePeriod = NesTimerTables::transposePeriod(timerTables.getTrianglePeriod(midiNoteNumber), offsetRatio);
+                break;
+
+            case vrc6PulseMode:
+                basePeriod = ExpansionTables::transposePeriod(expansionTables.getVrc6PulsePeriod(midiNoteNumber), offsetRatio);
+                expansion.setTable(expansionTables.getVrc6Pulse((int) vrc6Duty->load()));
+                break;
+
+            case vrc6SawMode:
+                basePeriod = ExpansionTables::transposePeriod(expansionTables.getVrc6SawPeriod(midiNoteNumber), offsetRatio);
+                expansion.setTable(expansionTables.getVrc6Saw());
+                break;
+
+            case n163Mode:
+                baseFrequency = 440.0f * FastExp2::semitonesToRatio((float) (midiNoteNumber - 69) + pitchOffset->load());
+                expansion.setTable(expansionTables.getN163Wave((int) n163Wave->load()));
+                heldSample = 0.0f;
+                holdPosition = 1.0;
+                break;
+
+            default:
+                basePeriod = NesTimerTables::transposePeriod(timerTables.getPulsePeriod(midiNoteNumber), offsetRatio);
+                break;
+        }
+
+        // pick up the channel's current bend, applied with the rest of the pitch below
+        noteBend = wheelToSemitones(currentPitchWheelPosition);
+        bendRatio = FastExp2::semitonesToRatio(noteBend + zoneBend);
+        bendChanged = false;
+
+        startEnvelope();
+
+        // the triangle's linear counter holds until the key is released
+        triangleLinearCounter.load(1);
+        triangleLinearCounter.setHalted(true);
+
+        //set pulse widths and sweep
+        sweeping = false;
+        if (mode == pulseMode) {
+            // a sweeping note moves its own copy of the period register
+            sweeping = sweepEnabled->load() > 0.5f;
+            if (sweeping)
+            {
+                const bool negate = sweepNegate->load() > 0.5f;
+
+                sweep1.setParameters(true, (int) sweepPeriod->load(), (int) sweepShift->load(), negate);
+                sweep2.setParameters(true, (int) sweepPeriod->load(), (int) sweepShift->load(), negate);
+                sweep1.setTimerPeriod(basePeriod);
+                sweep2.setTimerPeriod(basePeriod);
+            }
+
             pulse1.setPulseWidth(pulseWidth1Percent);
             pulse2.setPulseWidth(pulseWidth2Percent);
+            pulseWidthsEqual = pulseWidth1Percent == pulseWidth2Percent;
         }
-        
-        //store note
-        currentMidi = midiNoteNumber;
+
+        applyPitch();
+        alignOscillators(resources->blockStart + getEventPosition());
+        startCacheUse(midiNoteNumber);
     }
-    
+
     /**
      * Stops a note.
      * @param velocity The velocity of the note.
      * @param allowTailOff Determines if the note should fade out or stop abruptly.
      */
-    void stopNote(float velocity, bool allowTailOff) override
+    void noteStopped(float, bool allowTailOff) override
     {
+        // the cached start of a note only holds while the key is down
+        finishCacheUse();
+
         if (allowTailOff)
         {
             env.noteOff();
-            envSnare.noteOff();
-            envHat.noteOff();
-        } 
+
+            // release the triangle's linear counter so it runs out with the release stage
+            triangleLinearCounter.load(LengthCounter::ticksForTime(*releaseParam, FrameSequencer::quarterFrameRate));
+            triangleLinearCounter.setHalted(false);
+        }
         else
         {
             // Immediately stops the note if tail-off is not allowed
-            clearCurrentNote();
+            noteFinished();
             playing = false;
         }
     }
+
     /**
-     * Renders the next block of audio samples.
-     * @param outputBuffer The buffer to render the audio samples into.
-     * @param startSample The starting sample index.
-     * @param numSamples The number of samples to render.
+     * Per-channel pitch wheel. Outside MPE this is the ordinary bend; in MPE each note has its own
+     * member channel, so this is the note's own bend. The new pitch is picked up on the next frame tick.
+     * @param newValue Wheel position, 0 to 16383 with 8192 at centre.
      */
-    void renderNextBlock(juce::AudioSampleBuffer& outputBuffer, int startSample, int numSamples) override
+    void pitchWheelChanged(int newValue) override {
+        noteBend = wheelToSemitones(newValue);
+        bendChanged = true;
+    }
+
+    void controlReached(int controlId, float value) override
     {
-        if (playing) 
+        if (controlId == zoneBendControl)
         {
-            for (int sampleIndex = startSample; sampleIndex < (startSample + numSamples); ++sampleIndex)
-            {
-                float currentEnvSample = env.getNextSample();
-                // see if env is in attck phase
-                bool inAttackPhase = currentEnvSample > lastEnvSample;
-                
-                lastEnvSample = currentEnvSample;
-                
-                float outputSample = 0.0f;
-
-                // LFO and bit depth processing
-                float lfoValue = 0.0f;
-                if (typeLFO->load() == 0) //sin LFO
-                {
-                    sinLFO.setFrequency(*LFORate);
-                    lfoValue = sinLFO.process();
-                } 
-                else if (typeLFO->load() == 1)
-                {
-                    triLFO.setFrequency(*LFORate); //tri LFO
-                    lfoValue = triLFO.process();
-                } 
-                else if (typeLFO->load() == 2)
-                
-                {
-                    squareLFO.setFrequency(*LFORate); //square LFO
-                    squareLFO.setPulseWidth(0.5);
-                    lfoValue = squareLFO.process();
-                }
+            zoneBend = value;
+            bendChanged = true;
+        }
+    }
 
-                // Processing based on modeParam
-                if (modeParam->load() == 2) // process white noise for noise/drum channel
-                {
-                    // Noise processing for specific MIDI notes
-                    if (currentMidi == 60) 
-                    { // Hi-Hat Noise
-                        float rawSample = (random.nextFloat() * 2.0f - 1.0f) * envHat.getNextSample();;  // Hat noise with specific envelope
-                        outputSample = highHatFilter.processSingleSampleRaw(rawSample);//apply filter
-                    }
-                    else if (currentMidi == 62)
-                    { // Snare Noise
-                        float rawSample = (random.nextFloat() * 2.0f - 1.0f) * envSnare.getNextSample(); // Snare noise with specific envelope
-                        outputSample = snareFilter.processSingleSampleRaw(rawSample); //apply filter
-                    }
-                    else if (currentMidi == 64)
-                    {
-                        // White noise for all other keys
-                        outputSample = (random.nextFloat() * 2.0f - 1.0f) * currentEnvSample;
-                    }
-                    else 
-                    {
-                        continue;
-                    }
-                } else {
-                    // Regular synthesizer sound processing
-                    if (modeParam->load() == 0) //process bass
-                    {
-                        outputSample = bass.process() * currentEnvSample;
-                    } 
-                    else if (modeParam->load() == 1) //process pulses
-                    {
-                        bool pulseWidthsAreEqual = (*pulseWidth1Choice == *pulseWidth2Choice);
-                        
-                        if (pulseWidthsAreEqual)
-                        {
-                            outputSample = pulse1.process() * currentEnvSample;
-                        } 
-                        else
-                        {
-                            //this allows us to switch between cycle dutys if the pulse withs are different
-                            if (inAttackPhase)
-                            {
-                                //play first pulse for attack
-                                outputSample = pulse1.process() * currentEnvSample;
-                            } 
-                            else
-                            {
-                                //change to second pulse for remiander of note
-                                outputSample = pulse2.process() * currentEnvSample;
-                            }
-                        }
-                    }
-                }
+    void clockFrame(bool halfFrame) override
+    {
+        // bends arriving between ticks are applied here, once, as a frequency ratio
+        bool pitchChanged = bendChanged;
+        if (bendChanged)
+        {
+            finishCacheUse(); // from here on the note differs from the cached one
+            bendChanged = false;
+            bendRatio = FastExp2::semitonesToRatio(noteBend + zoneBend);
+        }
 
-                if (!(modeParam->load() == 2)) //do not bit crush white noise as this gets done later
-                {
-                    outputSample = bitcrushing(outputSample, lfoValue);
-                }
-                // Sample rate division processing
-                if (sampleIndex % static_cast<int>(*rateDivide) != 0) 
-                {
-                    outputSample = outputBuffer.getSample(0, sampleIndex - sampleIndex % static_cast<int>(*rateDivide));
-                }
+        env.clock();
+        triangleLinearCounter.clock();
 
-                for (int channel = 0; channel < outputBuffer.getNumChannels(); ++channel) 
-                {
-                    outputBuffer.addSample(channel, sampleIndex, outputSample);
-                }
+        gain = env.getGain();
+        bool finished = ! env.isActive();
 
-                //stop playing when env value is no longer active
-                if (!env.isActive()) 
-                {
-                    playing = false;
-                    
-                    clearCurrentNote();
-                }
+        if (mode == bassMode)
+            finished = finished || triangleLinearCounter.isSilenced();
+
+        // the N163's pitch and level depend on how many channels it is serving
+        if (mode == n163Mode && resources->n163Channels != n163Channels)
+        {
+            finishCacheUse();
+            pitchChanged = true;
+        }
+
+        // only the attack and decay are cached, the rest of the note is rendered live
+        if (cacheEntry >= 0 && env.getStage() != EnvelopeUnit::Stage::attack && env.getStage() != EnvelopeUnit::Stage::decay)
+            finishCacheUse();
+
+        // sweeps only touch the period register on half frames, and only retune when it moved
+        pulse1Gain = gain;
+        pulse2Gain = gain;
+
+        if (mode == pulseMode && sweeping)
+        {
+            if (halfFrame)
+            {
+                // evaluate both, the pulses sweep independently
+                const bool moved1 = sweep1.clock();
+                const bool moved2 = sweep2.clock();
+                pitchChanged = pitchChanged || moved1 || moved2;
             }
+
+            pulse1Gain = sweep1.isMuting() ? 0.0f : gain;
+            pulse2Gain = sweep2.isMuting() ? 0.0f : gain;
+        }
+
+        if (pitchChanged)
+            applyPitch();
+
+        inAttackPhase = env.getStage() == EnvelopeUnit::Stage::attack;
+
+        if (finished)
+        {
+            finishCacheUse();
+            playing = false;
+            noteFinished();
         }
     }
 
     /**
-     * Applies the bitcrushing effect to the input sample.
-     * @param sample The input sample to be processed.
-     * @param lfoValue The value of the LFO used for modulating bit depth.
-     * @return The bitcrushed output sample.
+     * Plays a run from the render cache while the note has an entry, and renders it live otherwise,
+     * recording it if the note is being cached.
      */
-    float bitcrushing(float sample, float lfoValue)
+    void renderRun(juce::AudioSampleBuffer& outputBuffer, int startSample, int numSamples) override
     {
-        // Calculate the modulated bit depth using the LFO value
-        float modulatedBitDepth = *bitDepth + lfoValue * (*bitDepthLFOAmount);
-        
-        // Ensure the modulated bit depth stays within a valid range
-        modulatedBitDepth = juce::jlimit(1.0f, 24.0f, modulatedBitDepth);
-        
-        // Calculate the bit depth power
-        float bitDepthPow = powf(2.0f, modulatedBitDepth) - 1.0f;
-        
-        // Apply bitcrushing and normalize the output sample
-        return floorf(sample * bitDepthPow + 0.5f) / bitDepthPow;
-    }
+        float* voiceBlock = resources->voiceBlock;
+        auto& cache = resources->renderCache;
+        int rendered = 0;
+
+        // the oscillators are moved on past the cached audio, so live rendering carries on seamlessly
+        if (cacheEntry >= 0 && ! cacheRecording)
+        {
+            rendered = cache.read(cacheEntry, cachePosition, voiceBlock, numSamples);
+            cachePosition += rendered;
+            skipOscillators(rendered);
+
+            if (rendered < numSamples)
+                finishCacheUse();
+        }
 
-    
-    
-    void pitchWheelMoved(int newValue) override {
-        // No pitch wheel functionality needed
+        if (rendered < numSamples)
+            renderLive(voiceBlock + rendered, numSamples - rendered, startSample + rendered);
+
+        if (cacheRecording && ! cache.append(cacheEntry, voiceBlock, numSamples))
+            finishCacheUse();
+
+        addToOutput(outputBuffer, startSample, voiceBlock, numSamples);
     }
-    
-    //--------------------------------------------------------------------------
-    void controllerMoved(int, int) override {}
-    //--------------------------------------------------------------------------
+
+private:
+    enum { zoneBendControl };
+
     /**
-     Can this voice play a sound. I wouldn't worry about this for the time being
-     
-     @param sound a juce::SynthesiserSound* base class pointer
-     @return sound cast as a pointer to an instance of YourSynthSound
+     * The LFO shape and the voice's source are chosen once for the whole run, and each is rendered
+     * with its oscillator's block loop, so the per-sample work is just the waveform itself and the crush.
+     * @param blockOffset Position of the run in the block, for the transport-locked LFO.
      */
-    bool canPlaySound (juce::SynthesiserSound* sound) override
+    void renderLive(float* voiceBlock, int numSamples, int blockOffset)
     {
-        return dynamic_cast<BitCrusherSound*> (sound) != nullptr;
-    }
-    //--------------------------------------------------------------------------
-private:
-    //--------------------------------------------------------------------------
-    // Set up any necessary variables here
-    /// Should the voice be playing?
-    bool playing = false;
-    
-    float lastEnvSample = 0.0f;
-    
-    
-    juce::IIRFilter highHatFilter;
-    juce::IIRFilter snareFilter;
-    
-    
-    SinOsc sinLFO;
-    TriOsc bass, triLFO;
-    SquareOsc pulse1, pulse2, squareLFO;
-    
-    /// a random object for use in our test noise function
-    juce::Random random;
-    juce::ADSR env, envHat, envSnare;
-    
-    std::atomic<float>* noiseAmount;
-    std::atomic<float>* bitDepth;
-    std::atomic<float>* rateDivide;
-    
-    std::atomic<float>* attackParam;
-    std::atomic<float>* decayParam;
-    std::atomic<float>* sustainParam;
-    std::atomic<float>* releaseParam;
-    
-    
-    std::atomic<float>* delayVolumeParam;
-    std::atomic<float>* pitchOffset;
-    
-    std::atomic<float>* pulseWidth1Choice;
-    std::atomic<float>* pulseWidth2Choice;
-    std::atomic<float>* modeParam;
-    
-    std::atomic<float>* bitDepthLFOAmount;
-    std::atomic<float>* LFORate;
-    std::atomic <float>* typeLFO;
-    
-    float lfoValue;
-    int currentMidi;
+        float* lfoBlock = resources->lfoBlock;
+        const double beatsPerCycle = TransportLFO::getBeatsPerCycle((int) lfoSync->load());
+
+        // LFO and bit depth processing; a synced LFO is worked out from the transport, not stepped
+        if (beatsPerCycle > 0.0)
+        {
+            resources->transportLFO.render((int) typeLFO->load(), resources->transport, beatsPerCycle,
+                                           blockOffset, lfoBlock, numSamples);
+        }
+        else
+        {
+            switch ((int) typeLFO->load())
+            {
+                case 0: //sin LFO
+                    sinLFO.setFrequency(*LFORate);
+                    sinLFO.processBlock(lfoBlock, numSamples);
+                    break;
+
+                case 1: //tri LFO
+                    triLFO.setFrequency(*LFORate);
+                    triLFO.processBlock(lfoBlock, numSamples);
+                    break;
+
+                case 2: //square LFO
+                    squareLFO.setFrequency(*LFORate);
+                    squareLFO.setPulseWidth(0.5);
+                    squareLFO.processBlock(lfoBlock, numSamples);
+                    break;
+
+                default:
+                    juce::FloatVectorOperations::clear(lfoBlock, numSamples);
+                    break;
+            }
+        }
+
+        if (mode == bassMode) //process bass
+        {
+            bass.processBlock(voiceBlock, numSamples);
+            juce::FloatVectorOperations::multiply(voiceBlock, gain, numSamples);
+        }
+        else if (mode != pulseMode) // expansion chip channel
+        {
+            expansion.processBlock(voiceBlock, numSamples);
+            juce::FloatVectorOperations::multiply(voiceBlock, gain * channelLevel, numSamples);
+
+            if (mode == n163Mode && holdStep < 1.0)
+                multiplexHold(voiceBlock, numSamples);
+        }
+        //this allows us to switch between cycle dutys if the pulse withs are different
+        else if (pulseWidthsEqual || inAttackPhase)
+        {
+            //play first pulse for attack
+            pulse1.processBlock(voiceBlock, numSamples);
+            juce::FloatVectorOperations::multiply(voiceBlock, pulse1Gain, numSamples);
+        }
+        else
+        {
+            //change to second pulse for remiander of note
+            pulse2.processBlock(voiceBlock, numSamples);
+            juce::FloatVectorOperations::multiply(voiceBlock, pulse2Gain, numSamples);
+        }
+
+        for (int i = 0; i < numSamples; ++i)
+            voiceBlock[i] = bitcrushing(voiceBlock[i], lfoBlock[i]);
+    }
+
+    /**
+     * Puts the oscillators and the free-running LFO where they would be had they been running at the
+     * note's pitch and the LFO rate all along. Voices are handed out at the start of the block, so which
+     * voice a note lands on can depend on the block size; this way its phase doesn't, while notes still
+     * start wherever a free-running oscillator happens to be, rather than all from the top.
+     * @param startSample The note's first sample, counted from prepareToPlay.
+     */
+    void alignOscillators(juce::int64 startSample)
+    {
+        bass.setPhaseFromStart(startSample);
+        pulse1.setPhaseFromStart(startSample);
+        pulse2.setPhaseFromStart(startSample);
+        expansion.setPhaseFromStart(startSample);
+
+        sinLFO.setFrequency(*LFORate);
+        triLFO.setFrequency(*LFORate);
+        squareLFO.setFrequency(*LFORate);
+        sinLFO.setPhaseFromStart(startSample);
+        triLFO.setPhaseFromStart(startSample);
+        squareLFO.setPhaseFromStart(startSample);
+    }
+
+    /** Advances exactly the oscillators renderLive would have run over numSamples. */
+    void skipOscillators(int numSamples)
+    {
+        const bool freeRunningLFO = TransportLFO::getBeatsPerCycle((int) lfoSync->load()) <= 0.0;
+
+        if (freeRunningLFO)
+        {
+            switch ((int) typeLFO->load())
+            {
+                case 0:  sinLFO.skip(numSamples); break;
+                case 1:  triLFO.skip(numSamples); break;
+                case 2:  squareLFO.skip(numSamples); break;
+                default: break;
+            }
+        }
+
+        if (mode == bassMode)
+            bass.skip(numSamples);
+        else if (mode != pulseMode)
+            expansion.skip(numSamples);
+        else if (pulseWidthsEqual || inAttackPhase)
+            pulse1.skip(numSamples);
+        else
+            pulse2.skip(numSamples);
+    }
+
+    /**
+     * Looks the note up in the render cache, or starts recording it. Only notes fully determined by
+     * the key are cached: the LFO must not be able to reach the crush, and the N163 mustn't be
+     * stepping its output. Every take of a note starts alike, as the oscillators restart at note on.
+     */
+    void startCacheUse(int midiNoteNumber)
+    {
+        finishCacheUse();
+
+        if (renderCacheEnabled == nullptr || renderCacheEnabled->load() < 0.5f)
+            return;
+
+        const float depth = bitDepth->load();
+        const float lfoAmount = std::abs(bitDepthLFOAmount->load());
+
+        if ((lfoAmount > 0.0f && depth - lfoAmount < 24.0f) || (mode == n163Mode && holdStep < 1.0))
+            return;
+
+        // a cached note is replayed from the top, so it is recorded from there too
+        bass.setPhase(0.0f);
+        pulse1.setPhase(0.0f);
+        pulse2.setPhase(0.0f);
+        expansion.setPhase(0.0f);
+
+        NoteRenderCache::Key key;
+        key.add(midiNoteNumber).add(mode).add((float) getSampleRate())
+           .add(attackParam->load()).add(decayParam->load()).add(sustainParam->load())
+           .add(pulseWidth1Choice->load()).add(pulseWidth2Choice->load()).add(vrc6Duty->load()).add(n163Wave->load())
+           .add(n163Channels).add(pitchOffset->load()).add(bendRatio).add(juce::jmin(24.0f, depth))
+           .add(sweeping ? 1 : 0).add(sweepPeriod->load()).add(sweepShift->load()).add(sweepNegate->load());
+
+        auto& cache = resources->renderCache;
+        cacheEntry = cache.acquire(key.hash);
+        cacheRecording = false;
+        cachePosition = 0;
+
+        if (cacheEntry < 0)
+        {
+            cacheEntry = cache.beginRecording(key.hash);
+            cacheRecording = cacheEntry >= 0;
+        }
+    }
+
+    /** Stops playing back or recording the note's cache entry. */
+    void finishCacheUse()
+    {
+        if (cacheEntry < 0)
+            return;
+
+        if (cacheRecording)
+            resources->renderCache.endRecording(cacheEntry);
+        else
+            resources->renderCache.release(cacheEntry);
+
+        cacheEntry = -1;
+        cacheRecording = false;
+    }
+
+    /**
+     * The N163 updates a channel's output only when its turn comes round, so with enough channels
+     * enabled the output steps at an audible rate. Emulated by holding each sample for a turn.
+     */
+    void multiplexHold(float* samples, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            holdPosition += holdStep;
+
+            if (holdPosition >= 1.0)
+            {
+                holdPosition -= std::floor(holdPosition);
+                heldSample = samples[i];
+            }
+
+            samples[i] = heldSample;
+        }
+    }
+
+    /** Maps a pitch wheel position to semitones using the bend range for the current MPE setting. */
+    float wheelToSemitones(int wheelValue) const
+    {
+        const float range = mpeEnabled->load() > 0.5f ? mpeBendRange->load() : bendRange->load();
+        return (float) (wheelValue - 8192) * (1.0f / 8192.0f) * range;
+    }
+
+    /**
+     * Points the oscillators at the timer period for the current note, sweep and bend. This is one
+     * period calculation and one table lookup per oscillator, done at note on and on frame ticks that
+     * changed the pitch.
+     */
+    void applyPitch()
+    {
+        const auto& timerTables = resources->timerTables;
+        const auto& expansionTables = resources->expansionTables;
+
+        switch (mode)
+        {
+            case bassMode:
+                bass.setPhaseIncrement(timerTables.getTriangleIncrement(NesTimerTables::transposePeriod(basePeriod, bendRatio)));
+                return;
+
+            case vrc6PulseMode:
+                expansion.setPhaseIncrement(expansionTables.getVrc6PulseIncrement(ExpansionTables::transposePeriod(basePeriod, bendRatio)));
+                channelLevel = 1.0f;
+                return;
+
+            case vrc6SawMode:
+                expansion.setPhaseIncrement(expansionTables.getVrc6SawIncrement(ExpansionTables::transposePeriod(basePeriod, bendRatio)));
+                channelLevel = 1.0f;
+                return;
+
+            case n163Mode:
+                // each of n channels gets the chip's output 1/n of the time, 15 CPU cycles per turn
+                n163Channels = resources->n163Channels;
+                expansion.setPhaseIncrement(expansionTables.getN163Increment(baseFrequency * bendRatio, n163Channels));
+                channelLevel = 1.0f / (float) n163Channels;
+                holdStep = ExpansionTables::cpuClock / (15.0 * n163Channels) / getSampleRate();
+                return;
+
+            default:
+                break;
+        }
+
+        const int period1 = sweeping ? sweep1.getTimerPeriod() : basePeriod;
+        const int period2 = sweeping ? sweep2.getTimerPeriod() : basePeriod;
+        pulse1.setPhaseIncrement(timerTables.getPulseIncrement(NesTimerTables::transposePeriod(period1, bendRatio)));
+        pulse2.setPhaseIncrement(timerTables.getPulseIncrement(NesTimerTables::transposePeriod(period2, bendRatio)));
+    }
+
+    //--------------------------------------------------------------------------
+    // hot: touched on every run or tick
+
+    // channel mode latched at note on, a ChannelMode other than noiseMode
+    int mode = pulseMode;
+
+    TriOsc bass;
+    TriLFO triLFO;
+    SquareOsc pulse1, pulse2, squareLFO;
+    SinOsc sinLFO;
+    WavetableOsc expansion;
+
+    // expansion chip level, and the N163 multiplexing latched from the resources
+    float channelLevel = 1.0f;
+    int n163Channels = 1;
+    double holdStep = 1.0, holdPosition = 1.0;
+    float heldSample = 0.0f;
+
+    // render cache entry the note plays from or records into, -1 if none
+    int cacheEntry = -1;
+    int cachePosition = 0;
+    bool cacheRecording = false;
+
+    float pulse1Gain = 0.0f, pulse2Gain = 0.0f;
+    bool inAttackPhase = false;
+    bool pulseWidthsEqual = true;
+    bool sweeping = false;
+    bool bendChanged = false;
+
+    LengthCounter triangleLinearCounter;
+
+    // pulse sweeps, pulse 1 negates with ones' complement like the hardware
+    SweepUnit sweep1 { SweepUnit::Negate::onesComplement };
+    SweepUnit sweep2 { SweepUnit::Negate::twosComplement };
+
+    // bend in semitones from the note's own channel and from the MPE master channel
+    float noteBend = 0.0f, zoneBend = 0.0f, bendRatio = 1.0f;
+
+    // timer period of the note before sweep and bend, or the N163 note's frequency in Hz
+    int basePeriod = 0;
+    float baseFrequency = 440.0f;
+
+    std::atomic<float>* bitDepth = nullptr;
+    std::atomic<float>* bitDepthLFOAmount = nullptr;
+    std::atomic<float>* LFORate = nullptr;
+    std::atomic<float>* typeLFO = nullptr;
+    std::atomic<float>* lfoSync = nullptr;
+
+    //--------------------------------------------------------------------------
+    // cold: read at note on or on wheel moves
+    std::atomic<float>* pitchOffset = nullptr;
+
+    std::atomic<float>* sweepEnabled = nullptr;
+    std::atomic<float>* sweepPeriod = nullptr;
+    std::atomic<float>* sweepShift = nullptr;
+    std::atomic<float>* sweepNegate = nullptr;
+
+    std::atomic<float>* bendRange = nullptr;
+    std::atomic<float>* mpeEnabled = nullptr;
+    std::atomic<float>* mpeBendRange = nullptr;
+
+    std::atomic<float>* pulseWidth1Choice = nullptr;
+    std::atomic<float>* pulseWidth2Choice = nullptr;
+
+    std::atomic<float>* vrc6Duty = nullptr;
+    std::atomic<float>* n163Wave = nullptr;
+    std::atomic<float>* renderCacheEnabled = nullptr;
+};
+
+//==============================================================================
+/**
+ * Noise channel voice, mode 2: filtered noise hi-hat (note 60) and snare (note 62), and plain white
+ * noise (note 64). The other keys of the noise channel belong to the sampler. Only the filter state is
+ * kept per voice; the coefficients are shared through VoiceResources.
+ */
+class NoiseDrumVoice : public NesVoice
+{
+public:
+    bool canPlaySound (juce::SynthesiserSound* sound) override
+    {
+        auto* nesSound = dynamic_cast<BitCrusherSound*> (sound);
+        return nesSound != nullptr && nesSound->channel == BitCrusherSound::Channel::noise;
+    }
+
+    /**
+     * Hits the hat or snare the voice is playing again, at the current event position, without a new
+     * voice: the hit envelope and length counter restart, while the noise and its filter carry on. The
+     * note's envelope carries on too, unless the old note was already released. The cheap retrigger
+     * used under load.
+     * @param midiNoteNumber The drum's note; ignored if the voice has moved on to another note.
+     */
+    void retrigger(int midiNoteNumber)
+    {
+        ++pendingRetriggers;
+        postControl(retriggerControl, (float) midiNoteNumber);
+    }
+
+protected:
+    void noteStarted (int midiNoteNumber, float, juce::SynthesiserSound*, int) override
+    {
+        // keys without a noise sound don't hold on to a voice
+        if (midiNoteNumber != 60 && midiNoteNumber != 62 && midiNoteNumber != 64)
+        {
+            noteFinished();
+            return;
+        }
+
+        playing = true;
+        startEnvelope();
+
+        // hat and snare are shaped by their own short hit envelope and a length counter
+        drum = midiNoteNumber == 60 ? DrumFilterBank::hat : (midiNoteNumber == 62 ? DrumFilterBank::snare : -1);
+        if (drum >= 0)
+            startHit();
+
+        filterState = {};
+
+        // the noise is seeded from where the note starts in the render, so takes are repeatable and
+        // hits still differ from one another
+        random.setSeed((resources->blockStart + getEventPosition()) * 128 + midiNoteNumber);
+    }
+
+    void noteStopped(float, bool allowTailOff) override
+    {
+        if (allowTailOff)
+        {
+            env.noteOff();
+            hitEnv.noteOff();
+        }
+        else
+        {
+            noteFinished();
+            playing = false;
+        }
+    }
+
+    void controlReached(int controlId, float value) override
+    {
+        if (controlId != retriggerControl)
+            return;
+
+        --pendingRetriggers;
+
+        if (drum < 0 || getCurrentlyPlayingNote() != (int) value)
+            return;
+
+        // a released note's envelope would end the new hit with it, and the ring may even have ended
+        // earlier in the block, the voice kept for this hit
+        if (! env.isActive() || env.getStage() == EnvelopeUnit::Stage::release)
+            startEnvelope();
+
+        playing = true;
+        startHit();
+    }
+
+    void clockFrame(bool halfFrame) override
+    {
+        env.clock();
+        bool finished = ! env.isActive();
+
+        if (drum >= 0)
+        {
+            hitEnv.clock();
+            if (halfFrame)
+                hitLength.clock();
+
+            gain = hitEnv.getGain();
+            finished = finished || hitLength.isSilenced() || ! hitEnv.isActive();
+        }
+        else
+        {
+            gain = env.getGain();
+        }
+
+        if (finished)
+        {
+            playing = false;
+
+            // a retrigger later in the block still needs the voice
+            if (pendingRetriggers == 0)
+                noteFinished();
+        }
+    }
+
+    void renderRun(juce::AudioSampleBuffer& outputBuffer, int startSample, int numSamples) override
+    {
+        float* voiceBlock = resources->voiceBlock;
+
+        for (int i = 0; i < numSamples; ++i)
+            voiceBlock[i] = (random.nextFloat() * 2.0f - 1.0f) * gain;
+
+        if (drum >= 0)
+            filter(resources->drumFilters.coefficients[drum], voiceBlock, numSamples);
+
+        // noise is not crushed here, the processor crushes the whole noise channel later
+        addToOutput(outputBuffer, startSample, voiceBlock, numSamples);
+    }
+
+private:
+    enum { retriggerControl };
+
+    /** Starts the hat or snare's own hit envelope and length counter. */
+    void startHit()
+    {
+        const float hitDecay = drum == DrumFilterBank::hat ? 0.08f : 0.15f; // hat is shorter than snare
+        hitEnv.setParameters(0.01f, hitDecay, 0.0f, 0.01f);
+        hitEnv.noteOn();
+        hitLength.load(LengthCounter::ticksForTime(0.01f + hitDecay, FrameSequencer::quarterFrameRate * 0.5));
+    }
+
+    /** Transposed direct form II biquad, as in juce::IIRFilter, with the state kept in this voice. */
+    void filter(const juce::IIRCoefficients& c, float* samples, int numSamples)
+    {
+        const float* k = c.coefficients;
+        float v1 = filterState.v1, v2 = filterState.v2;
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const float in = samples[i];
+            const float out = k[0] * in + v1;
+            v1 = k[1] * in - k[3] * out + v2;
+            v2 = k[2] * in - k[4] * out;
+            samples[i] = out;
+        }
+
+        filterState.v1 = v1;
+        filterState.v2 = v2;
+    }
+
+    // hot: touched on every run or tick
+    struct FilterState { float v1 = 0.0f, v2 = 0.0f; } filterState;
+    int drum = -1;
+    int pendingRetriggers = 0; // queued for this block, applied before it ends
+    EnvelopeUnit hitEnv;
+    LengthCounter hitLength;
+
+    /// the noise source, seeded at every note
+    juce::Random random;
+};
+
+// =================================
+// =================================
+// Synthesiser
+
+/**
+ * Synthesiser that understands the MPE lower zone. With MPE on, channel 1 is the zone's master channel
+ * and its pitch wheel bends every voice; all other channels carry per-note bends, which the base class
+ * already routes to the voice playing on that channel.
+ */
+class NesSynthesiser : public BatchedSynthesiser
+{
+public:
+    void setParametersFromAPVTS(juce::AudioProcessorValueTreeState& apvts)
+    {
+        bendRange = apvts.getRawParameterValue("bendRange");
+        mpeEnabled = apvts.getRawParameterValue("mpeEnabled");
+        n163Multiplex = apvts.getRawParameterValue("n163Multiplex");
+        modeParam = apvts.getRawParameterValue("mode");
+    }
+
+    void handlePitchWheel(int midiChannel, int wheelValue) override
+    {
+        if (mpeEnabled->load() > 0.5f && midiChannel == 1)
+        {
+            const float semitones = (float) (wheelValue - 8192) * (1.0f / 8192.0f) * bendRange->load();
+
+            // every voice, sounding or not, so notes started later pick up the zone bend too
+            for (int i = 0; i < getNumVoices(); ++i)
+                if (auto* voice = dynamic_cast<MelodicVoice*>(getVoice(i)))
+                    voice->setZoneBend(semitones);
+
+            return;
+        }
+
+        BatchedSynthesiser::handlePitchWheel(midiChannel, wheelValue);
+    }
+
+    void noteOn(int midiChannel, int midiNoteNumber, float velocity) override
+    {
+        // the routing is decided once, here: only the sound for the current mode starts a voice, and the
+        // note off stops that voice by its note number, as the base class does, even if the mode has changed
+        const auto channel = (int) modeParam->load() == noiseMode ? BitCrusherSound::Channel::noise
+                                                                  : BitCrusherSound::Channel::melodic;
+
+        // with retriggers off, a hat or snare that is still ringing is hit again on its own voice
+        // instead of starting a second one over its tail
+        if (! drumRetriggers && channel == BitCrusherSound::Channel::noise && (midiNoteNumber == 60 || midiNoteNumber == 62))
+        {
+            for (auto* voice : noiseVoices)
+            {
+                if (voice->isVoiceActive() && voice->getCurrentlyPlayingNote() == midiNoteNumber
+                      && voice->isPlayingChannel(midiChannel))
+                {
+                    voice->retrigger(midiNoteNumber);
+                    return;
+                }
+            }
+        }
+        const juce::ScopedLock sl(lock);
+
+        for (auto* sound : sounds)
+        {
+            auto* nesSound = dynamic_cast<BitCrusherSound*>(sound);
+            if (nesSound == nullptr || nesSound->channel != channel || ! sound->appliesToChannel(midiChannel))
+                continue;
+
+            // a note still ringing on the pedals is stopped before it is hit again, as in the base class
+            for (auto* voice : voices)
+                if (voice->getCurrentlyPlayingNote() == midiNoteNumber && voice->isPlayingChannel(midiChannel))
+                    stopVoice(voice, 1.0f, true);
+
+            startVoice(findFreeVoice(sound, midiChannel, midiNoteNumber, isNoteStealingEnabled()),
+                       sound, midiChannel, midiNoteNumber, velocity);
+        }
+    }
+
+    /**
+     * Lets repeated hat and snare hits take new voices, or hit the ringing voice again instead. Turned
+     * off by the processor under load; every hit still sounds either way.
+     * @param shouldRetrigger True for normal playing.
+     */
+    void setDrumRetriggers(bool shouldRetrigger)
+    {
+        drumRetriggers = shouldRetrigger;
+    }
+
+    /**
+     * Caps the number of sounding voices, stealing released voices before held ones. Voices over a new
+     * limit are cut at the start of the next block.
+     * @param maxVoices The cap, or 0 for every voice.
+     */
+    void setVoiceLimit(int maxVoices)
+    {
+        voiceLimit = maxVoices;
+    }
+
+    /**
+     * Prepares the tables, mixer and buses. Called from prepareToPlay.
+     * @param sampleRate The audio sample rate.
+     * @param maximumBlockSize Largest block the host will ask for.
+     */
+    void prepare(double sampleRate, int maximumBlockSize)
+    {
+        resources.blockStart = 0;
+        buses.setSize(NesMixer::numBuses, juce::jmax(1, maximumBlockSize));
+        resources.renderCache.prepare((int) (renderCacheSeconds * sampleRate));
+        setCurrentPlaybackSampleRate(sampleRate);
+    }
+
+    /** Rebuilds the timer tables, drum filters and mixer for the new rate before any voice plays at it. */
+    void setCurrentPlaybackSampleRate(double sampleRate) override
+    {
+        resources.prepare(sampleRate);
+        mixer.prepare(sampleRate);
+        BatchedSynthesiser::setCurrentPlaybackSampleRate(sampleRate);
+    }
+
+    /**
+     * Renders the voices into the mono pulse, triangle/noise and expansion buses, runs those through the
+     * NES mixer and output filters, and adds the mono result to every channel of the output.
+     *
+     * N163 multiplexing is emulated per block: the channels sounding when the block starts set how many
+     * the chip serves, which the voices turn into their level, pitch rounding and output stepping.
+     * @param outputBuffer The buffer to add the synth into.
+     * @param events The block's MIDI, shared with the other engines.
+     */
+    void renderBlock(juce::AudioBuffer<float>& outputBuffer, const MidiEventList& events)
+    {
+        const int numSamples = outputBuffer.getNumSamples();
+
+        // only if the host breaks its promised maximum block size
+        if (buses.getNumSamples() < numSamples)
+            buses.setSize(NesMixer::numBuses, numSamples, false, false, true);
+
+        int n163Channels = 1;
+        if (n163Multiplex != nullptr && n163Multiplex->load() > 0.5f)
+        {
+            n163Channels = 0;
+            for (auto* voice : melodicVoices)
+                n163Channels += voice->isPlayingN163() ? 1 : 0;
+        }
+
+        resources.n163Channels = juce::jlimit(1, ExpansionTables::maxN163Channels, n163Channels);
+
+        if (voiceLimit > 0)
+            for (int active = countActiveVoices(); active > voiceLimit; --active)
+                if (auto* voice = findVoiceToShed(nullptr))
+                    stopVoice(voice, 0.0f, false);
+
+        buses.clear(0, numSamples);
+        BatchedSynthesiser::renderBlock(buses, events, numSamples);
+
+        float* mono = buses.getWritePointer(NesMixer::pulseBus);
+        mixer.process(buses.getReadPointer(NesMixer::pulseBus), buses.getReadPointer(NesMixer::tndBus),
+                      buses.getReadPointer(NesMixer::expansionBus), mono, numSamples);
+
+        for (int channel = 0; channel < outputBuffer.getNumChannels(); ++channel)
+            juce::FloatVectorOperations::add(outputBuffer.getWritePointer(channel), mono, numSamples);
+
+        resources.blockStart += numSamples;
+    }
+
+    /**
+     * Moves the sample count that the rate division and the noise seeds run on, as if this many
+     * samples had been rendered. For starting a render part-way through.
+     */
+    void setRenderPosition(juce::int64 samplePosition)
+    {
+        resources.blockStart = samplePosition;
+    }
+
+    /** Adds the sample count and the NES mixer's filters to the base class's checkpoint. */
+    void saveState(juce::OutputStream& out) const override
+    {
+        BatchedSynthesiser::saveState(out);
+        out.writeInt64(resources.blockStart);
+        mixer.saveState(out);
+    }
+
+    bool restoreState(juce::InputStream& in) override
+    {
+        if (! BatchedSynthesiser::restoreState(in))
+            return false;
+
+        resources.blockStart = in.readInt64();
+        mixer.restoreState(in);
+        return true;
+    }
+
+    /** Hands the voices the host's position for the block about to be rendered. */
+    void setTransport(const TransportPosition& position)
+    {
+        resources.transport = position;
+    }
+
+    /** Cached note starts, for hit rate and memory reporting. */
+    const NoteRenderCache& getRenderCache() const { return resources.renderCache; }
+
+    /** Adds a voice and points it at the shared tables and scratch buffers. */
+    void addNesVoice(NesVoice* voice)
+    {
+        voice->setResources(&resources);
+        addBatchedVoice(voice);
+
+        if (auto* melodic = dynamic_cast<MelodicVoice*>(voice))
+            melodicVoices.add(melodic);
+        else if (auto* noise = dynamic_cast<NoiseDrumVoice*>(voice))
+            noiseVoices.add(noise);
+    }
+
+protected:
+    juce::SynthesiserVoice* findFreeVoice(juce::SynthesiserSound* sound, int midiChannel, int midiNoteNumber,
+                                          bool stealIfNoneAvailable) const override
+    {
+        if (voiceLimit > 0 && countActiveVoices() >= voiceLimit)
+            return stealIfNoneAvailable ? findVoiceToShed(sound) : nullptr;
+
+        return BatchedSynthesiser::findFreeVoice(sound, midiChannel, midiNoteNumber, stealIfNoneAvailable);
+    }
+
+private:
+    int countActiveVoices() const
+    {
+        int active = 0;
+        for (auto* voice : voices)
+            active += voice->isVoiceActive() ? 1 : 0;
+
+        return active;
+    }
+
+    /**
+     * The voice to give up when over the voice limit: the oldest one that has been released, or else
+     * the oldest still held.
+     * @param sound Only voices that can play this sound, or any voice if nullptr.
+     */
+    juce::SynthesiserVoice* findVoiceToShed(juce::SynthesiserSound* sound) const
+    {
+        juce::SynthesiserVoice* oldestReleased = nullptr;
+        juce::SynthesiserVoice* oldestHeld = nullptr;
+
+        for (auto* voice : voices)
+        {
+            if (! voice->isVoiceActive() || (sound != nullptr && ! voice->canPlaySound(sound)))
+                continue;
+
+            auto*& oldest = voice->isPlayingButReleased() ? oldestReleased : oldestHeld;
+            if (oldest == nullptr || voice->wasStartedBefore(*oldest))
+                oldest = voice;
+        }
+
+        return oldestReleased != nullptr ? oldestReleased : oldestHeld;
+    }
+
+    /** Audio the render cache can hold, across all entries. */
+    static constexpr double renderCacheSeconds = 8.0;
+
+    VoiceResources resources;
+    NesMixer mixer;
+    juce::AudioBuffer<float> buses;
+    juce::Array<MelodicVoice*> melodicVoices;
+    juce::Array<NoiseDrumVoice*> noiseVoices;
+
+    // lowered by the processor's LoadGovernor
+    bool drumRetriggers = true;
+    int voiceLimit = 0;
+
+    std::atomic<float>* bendRange = nullptr;
+    std::atomic<float>* mpeEnabled = nullptr;
+    std::atomic<float>* n163Multiplex = nullptr;
+    std::atomic<float>* modeParam = nullptr;
 };
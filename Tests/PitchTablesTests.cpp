@@ -0,0 +1,54 @@
+/*
+  ==============================================================================
+
+    PitchTablesTests.cpp
+    Created: 19 Oct 2026 3:07:40am
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../PitchTables.h"
+
+class FastExp2Tests : public juce::UnitTest
+{
+public:
+    FastExp2Tests() : juce::UnitTest("FastExp2", "NES Synth") {}
+
+    void runTest() override
+    {
+        beginTest("Tiny negative exponents stay inside the table");
+        {
+            // x - floor(x) rounds to 1.0f here, which used to index one past the end
+            for (auto x : { -1e-9f, -1e-12f, -std::numeric_limits<float>::denorm_min(), -3.0f - 1e-7f })
+            {
+                const float result = FastExp2::exp2(x);
+                expect(std::isfinite(result));
+                expectWithinAbsoluteError(result, std::exp2(x), std::exp2(x) * 1e-4f);
+            }
+
+            expectEquals(FastExp2::exp2(-1e-9f), 1.0f);
+        }
+
+        beginTest("Matches std::exp2 across the pitch range");
+        {
+            auto random = getRandom();
+
+            for (int i = 0; i < 10000; ++i)
+            {
+                const float x = random.nextFloat() * 20.0f - 10.0f;
+                const float expected = std::exp2(x);
+                expectWithinAbsoluteError(FastExp2::exp2(x), expected, expected * 1e-4f);
+            }
+        }
+
+        beginTest("Whole octaves are exact");
+        {
+            for (int octave = -10; octave <= 10; ++octave)
+                expectEquals(FastExp2::exp2((float) octave), std::ldexp(1.0f, octave));
+        }
+    }
+};
+
+static FastExp2Tests fastExp2Tests;
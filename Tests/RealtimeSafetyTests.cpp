@@ -0,0 +1,174 @@
+/*
+  ==============================================================================
+
+    RealtimeSafetyTests.cpp
+    Created: 19 Oct 2026 3:42:09am
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "TestHelpers.h"
+
+/**
+ * Plays a corpus of MIDI and automation through the engine in real-time mode, at changing block
+ * sizes, and checks with the AllocationTracer that processBlock never touches the heap or takes a
+ * lock shared with another thread, whatever the patch and whatever arrives.
+ */
+class RealtimeSafetyTests : public juce::UnitTest
+{
+public:
+    RealtimeSafetyTests() : juce::UnitTest("Real-time safety of processBlock", "NES Synth") {}
+
+    void runTest() override
+    {
+        for (int mode = 0; mode < 6; ++mode)
+        {
+            beginTest("Mode " + juce::String(mode) + ": chords, pedals, wheels and drums");
+            play({ { "mode", (float) mode } }, {});
+        }
+
+        beginTest("Arpeggiator with a synced LFO");
+        play({ { "arpEnabled", 0.0f }, { "arpRate", 4.0f }, { "lfoSync", 5.0f }, { "typeLFO", 2.0f } }, {});
+
+        beginTest("Reverb, input effect and crusher");
+        play({ { "reverbToggle", 1.0f }, { "reverbWet", 0.6f }, { "reverbRoomSize", 0.8f },
+               { "inputEffect", 1.0f }, { "inputSynthMix", 0.5f }, { "bitDepth", 6.0f }, { "rateDivide", 4.0f } }, {});
+
+        beginTest("Note cache, MPE and sweeps");
+        play({ { "renderCache", 1.0f }, { "mpeEnabled", 1.0f }, { "sweepEnabled", 1.0f } }, {});
+
+        beginTest("Lowest CPU budget, every degradation level");
+        play({ { "cpuBudget", 0.1f }, { "reverbToggle", 1.0f } }, {});
+
+        beginTest("Every parameter automated");
+        {
+            auto random = getRandom();
+            play({}, [&random](SynthExampleAudioProcessor& engine, int block)
+            {
+                if (block % 8 != 0)
+                    return;
+
+                for (auto* parameter : engine.getParameters())
+                    if (random.nextInt(4) == 0)
+                        parameter->setValueNotifyingHost(random.nextFloat());
+            });
+        }
+
+        beginTest("Preset switches while notes play");
+        {
+            const juce::MemoryBlock presets[] = {
+                TestHelpers::makeState({ { "mode", 0.0f }, { "reverbToggle", 1.0f } }),
+                TestHelpers::makeState({ { "mode", 2.0f }, { "arpEnabled", 0.0f } }),
+                TestHelpers::makeState({ { "mode", 4.0f }, { "lfoSync", 3.0f }, { "bitDepth", 4.0f } })
+            };
+
+            play({}, [&presets](SynthExampleAudioProcessor& engine, int block)
+            {
+                if (block % 50 == 0)
+                {
+                    const auto& preset = presets[(block / 50) % 3];
+                    engine.setStateInformation(preset.getData(), (int) preset.getSize());
+                }
+            });
+        }
+    }
+
+private:
+    static constexpr double sampleRate = 48000.0;
+    static constexpr int maxBlockSize = 512;
+    static constexpr int numBlocks = 1500;
+
+    using Automation = std::function<void(SynthExampleAudioProcessor&, int block)>;
+
+    /**
+     * Renders the MIDI corpus through a fresh engine and expects no violations.
+     * @param parameters The patch, in the parameters' own units.
+     * @param automate Called between blocks, as a host's automation would be.
+     */
+    void play(std::initializer_list<std::pair<const char*, float>> parameters, const Automation& automate)
+    {
+        SynthExampleAudioProcessor engine;
+
+        for (const auto& parameter : parameters)
+            expect(TestHelpers::setParameter(engine, parameter.first, parameter.second), parameter.first);
+
+        engine.setRateAndBufferSizeDetails(sampleRate, maxBlockSize);
+        engine.prepareToPlay(sampleRate, maxBlockSize);
+        expect(engine.waitForSampleKit(10000));
+
+        juce::AudioBuffer<float> block(2, maxBlockSize);
+        juce::MidiBuffer midi;
+        midi.ensureSize(4096);
+
+        juce::Random random(1234);
+        static constexpr int blockSizes[] = { 512, 64, 1, 300, 17, 128, 2, 511 };
+
+        const auto violationsBefore = AllocationTracer::getViolations();
+        bool finite = true;
+
+        for (int i = 0; i < numBlocks; ++i)
+        {
+            if (automate)
+                automate(engine, i);
+
+            const int numSamples = blockSizes[i % juce::numElementsInArray(blockSizes)];
+            midi.clear();
+            addEvents(midi, numSamples, random);
+
+            // the input carries a tone for effect mode
+            for (int channel = 0; channel < 2; ++channel)
+                for (int s = 0; s < numSamples; ++s)
+                    block.setSample(channel, s, 0.25f * std::sin(0.01f * (float) (i * maxBlockSize + s + channel * 7)));
+
+            juce::AudioBuffer<float> view(block.getArrayOfWritePointers(), 2, numSamples);
+            engine.processBlock(view, midi);
+
+            for (int channel = 0; channel < 2 && finite; ++channel)
+                for (int s = 0; s < numSamples && finite; ++s)
+                    finite = std::isfinite(view.getSample(channel, s));
+        }
+
+        expect(finite, "a block rendered a NaN or infinity");
+        expectEquals((int) (AllocationTracer::getViolations() - violationsBefore), 0,
+                     "processBlock allocated, freed or took a shared lock");
+    }
+
+    /** A block's worth of a busy performance: notes on several channels, pedals, wheels and panics. */
+    static void addEvents(juce::MidiBuffer& midi, int numSamples, juce::Random& random)
+    {
+        const int numEvents = random.nextInt(6);
+
+        for (int e = 0; e < numEvents; ++e)
+        {
+            const int position = random.nextInt(numSamples);
+            const int channel = 1 + random.nextInt(4);
+            const int note = 36 + random.nextInt(40);
+
+            switch (random.nextInt(10))
+            {
+                case 0: case 1: case 2: case 3:
+                    midi.addEvent(juce::MidiMessage::noteOn(channel, note, (juce::uint8) (1 + random.nextInt(127))), position);
+                    break;
+                case 4: case 5: case 6:
+                    midi.addEvent(juce::MidiMessage::noteOff(channel, note), position);
+                    break;
+                case 7:
+                    midi.addEvent(juce::MidiMessage::controllerEvent(channel, 64, random.nextBool() ? 127 : 0), position);
+                    break;
+                case 8:
+                    midi.addEvent(juce::MidiMessage::pitchWheel(channel, random.nextInt(16384)), position);
+                    break;
+                default:
+                    if (random.nextInt(20) == 0)
+                        midi.addEvent(juce::MidiMessage::allNotesOff(channel), position);
+                    else
+                        midi.addEvent(juce::MidiMessage::controllerEvent(channel, 1, random.nextInt(128)), position);
+                    break;
+            }
+        }
+    }
+};
+
+static RealtimeSafetyTests realtimeSafetyTests;
@@ -0,0 +1,166 @@
+/*
+  ==============================================================================
+
+    RenderInvarianceTests.cpp
+    Created: 19 Oct 2026 4:02:31am
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "TestHelpers.h"
+#include "../RenderCheck.h"
+
+/**
+ * Runs RenderCheck over a small MIDI corpus with patches that exercise everything that keeps time:
+ * the free and transport-synced LFOs, the arpeggiator on and off, rate division, the reverb and the
+ * drums, without a play head and with a stopped one. Every take must hash the same whatever the block
+ * sizes. The corpus stays within the voice count and out of N163 mode, which RenderCheck doesn't cover.
+ */
+class RenderInvarianceTests : public juce::UnitTest
+{
+public:
+    RenderInvarianceTests() : juce::UnitTest("Block size invariance", "NES Synth") {}
+
+    void runTest() override
+    {
+        const auto chords = makeChords();
+        const auto lines = makeLines();
+
+        beginTest("Pulse, arpeggiator off, free LFO");
+        expectInvariant(TestHelpers::makeState({ { "bitDepth", 8.0f }, { "bitDepthLFOAmount", 4.0f } }), { chords, lines });
+
+        beginTest("Bass with a triangle LFO synced to 1/8");
+        expectInvariant(TestHelpers::makeState({ { "mode", 0.0f }, { "bitDepth", 8.0f }, { "bitDepthLFOAmount", 4.0f },
+                                                 { "typeLFO", 1.0f }, { "lfoSync", 5.0f } }), { chords, lines });
+
+        beginTest("Arpeggiator on with a square LFO synced to 1/16");
+        expectInvariant(TestHelpers::makeState({ { "arpEnabled", 0.0f }, { "arpRate", 4.0f }, { "bitDepth", 6.0f },
+                                                 { "bitDepthLFOAmount", 3.0f }, { "typeLFO", 2.0f }, { "lfoSync", 6.0f } }),
+                        { chords, lines });
+
+        beginTest("Arpeggiator on, free LFO, rate division and reverb");
+        expectInvariant(TestHelpers::makeState({ { "arpEnabled", 0.0f }, { "arpRate", 8.0f }, { "bitDepth", 10.0f },
+                                                 { "bitDepthLFOAmount", 5.0f }, { "LFORate", 3.0f }, { "rateDivide", 3.0f },
+                                                 { "reverbToggle", 1.0f }, { "reverbWet", 0.5f }, { "reverbRoomSize", 0.7f } }),
+                        { chords, lines });
+
+        beginTest("VRC6 saw with a pitch offset");
+        expectInvariant(TestHelpers::makeState({ { "mode", 4.0f }, { "pitchOffset", 5.0f } }), { chords, lines });
+
+        beginTest("Noise drums and samples");
+        expectInvariant(TestHelpers::makeState({ { "mode", 2.0f } }), { makeDrums() });
+
+        // played live: the host is stopped and keeps reporting where it stopped
+        StoppedPlayHead stopped;
+
+        beginTest("Synced LFO with the host stopped");
+        expectInvariant(TestHelpers::makeState({ { "bitDepth", 8.0f }, { "bitDepthLFOAmount", 4.0f }, { "typeLFO", 1.0f },
+                                                 { "lfoSync", 5.0f } }), { chords, lines }, &stopped);
+
+        beginTest("Arpeggiator on with the host stopped");
+        expectInvariant(TestHelpers::makeState({ { "arpEnabled", 0.0f }, { "arpRate", 4.0f } }), { chords }, &stopped);
+    }
+
+private:
+    static constexpr double sampleRate = 44100.0;
+    static constexpr int numSamples = 66150; // 1.5 seconds
+
+    /** A host that isn't playing, at a fixed position and tempo. */
+    class StoppedPlayHead : public juce::AudioPlayHead
+    {
+    public:
+        juce::Optional<PositionInfo> getPosition() const override
+        {
+            PositionInfo info;
+            info.setIsPlaying(false);
+            info.setPpqPosition(17.25);
+            info.setBpm(132.0);
+            return info;
+        }
+    };
+
+    /**
+     * Expects every take of every piece of MIDI to hash the same.
+     * @param playHead The host's play head, or nullptr for none.
+     */
+    void expectInvariant(const juce::MemoryBlock& state, std::initializer_list<juce::MidiBuffer> corpus,
+                         juce::AudioPlayHead* playHead = nullptr)
+    {
+        int index = 0;
+
+        for (const auto& midi : corpus)
+        {
+            juce::Array<RenderCheck::Take> takes;
+            const bool identical = RenderCheck::check(state, midi, numSamples, sampleRate, takes, playHead);
+
+            juce::String hashes;
+            for (const auto& take : takes)
+                hashes << juce::String::toHexString((juce::int64) take.hash) << " ";
+
+            expect(identical, "MIDI " + juce::String(index) + " differs between block sizes: " + hashes);
+            ++index;
+        }
+    }
+
+    /** Overlapping chords under the sustain pedal, with bends, offs landing on the next chord's on. */
+    static juce::MidiBuffer makeChords()
+    {
+        juce::MidiBuffer midi;
+        const int chords[][3] = { { 48, 55, 64 }, { 50, 57, 65 }, { 43, 55, 62 }, { 45, 52, 60 } };
+
+        for (int c = 0; c < 4; ++c)
+        {
+            const int start = c * 15000 + 37;
+
+            for (int n = 0; n < 3; ++n)
+            {
+                midi.addEvent(juce::MidiMessage::noteOn(1, chords[c][n], (juce::uint8) (70 + 10 * n)), start + 101 * n);
+                midi.addEvent(juce::MidiMessage::noteOff(1, chords[c][n]), start + 15000);
+            }
+
+            midi.addEvent(juce::MidiMessage::pitchWheel(1, 8192 + 1500 * (c % 2 == 0 ? 1 : -1)), start + 4000);
+        }
+
+        midi.addEvent(juce::MidiMessage::controllerEvent(1, 64, 127), 20000);
+        midi.addEvent(juce::MidiMessage::controllerEvent(1, 64, 0), 41000);
+        midi.addEvent(juce::MidiMessage::pitchWheel(1, 8192), 50000);
+        return midi;
+    }
+
+    /** A fast legato line, each note ending as or just after the next begins. */
+    static juce::MidiBuffer makeLines()
+    {
+        juce::MidiBuffer midi;
+
+        for (int i = 0; i < 40; ++i)
+        {
+            const int note = 60 + (i * 5) % 12;
+            const int start = 1000 + i * 1511;
+            midi.addEvent(juce::MidiMessage::noteOn(1, note, (juce::uint8) (50 + i)), start);
+            midi.addEvent(juce::MidiMessage::noteOff(1, note), start + 1511 + (i % 3) * 200);
+        }
+
+        return midi;
+    }
+
+    /** Hat, snare and kick on the noise voice, and the sample kit, with quick repeats. */
+    static juce::MidiBuffer makeDrums()
+    {
+        juce::MidiBuffer midi;
+        const int notes[] = { 60, 62, 64, 53, 55, 57, 59, 60, 60, 62 };
+
+        for (int i = 0; i < 60; ++i)
+        {
+            const int note = notes[i % juce::numElementsInArray(notes)];
+            const int start = 500 + i * 1013;
+            midi.addEvent(juce::MidiMessage::noteOn(1, note, (juce::uint8) (40 + i)), start);
+            midi.addEvent(juce::MidiMessage::noteOff(1, note), start + 700);
+        }
+
+        return midi;
+    }
+};
+
+static RenderInvarianceTests renderInvarianceTests;
@@ -0,0 +1,35 @@
+/*
+  ==============================================================================
+
+    RunTests.cpp
+    Created: 19 Oct 2026 3:05:12am
+    Author:  Caitlin Earley
+
+    Entry point of the console test target: the plugin sources, BinaryData and
+    every file in this folder, built without the plugin wrapper and with
+    NES_TRACE_ALLOCATIONS=1, so the tests can see what processBlock does.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../AllocationTracer.h"
+
+#if ! NES_TRACE_ALLOCATIONS
+ #error "Build the test target with NES_TRACE_ALLOCATIONS=1"
+#endif
+
+int main()
+{
+    const juce::ScopedJuceInitialiser_GUI juce;
+
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+    runner.runTestsInCategory("NES Synth");
+
+    int failures = 0;
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        failures += runner.getResult(i)->failures;
+
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+/*
+  ==============================================================================
+
+    SampleKitStressTests.cpp
+    Created: 19 Oct 2026 3:21:48am
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "TestHelpers.h"
+
+/**
+ * Swaps sample kits from another thread as fast as the loader will take them while blocks of drum hits
+ * render in real-time mode, and checks that processBlock never touches the heap or a shared lock, that
+ * every block stays finite and that the last kit asked for is the one that ends up loaded.
+ */
+class SampleKitStressTests : public juce::UnitTest
+{
+public:
+    SampleKitStressTests() : juce::UnitTest("Sample kit swaps under load", "NES Synth") {}
+
+    void runTest() override
+    {
+        beginTest("Kits swap while blocks render, without heap use in processBlock");
+
+        const auto directory = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                                   .getChildFile("NES Synth sample kit test").getNonexistentSibling();
+        expect(directory.createDirectory().wasOk());
+
+        // every swap has to decode or resample: the kits use different files, rates and note ranges
+        juce::Array<SampleMapping> kits[2];
+        for (int i = 0; i < 4; ++i)
+        {
+            const auto fileA = directory.getChildFile("a" + juce::String(i) + ".wav");
+            const auto fileB = directory.getChildFile("b" + juce::String(i) + ".wav");
+            expect(TestHelpers::writeTone(fileA, 44100.0, 8000 + 3000 * i, 220.0f * (float) (i + 1)));
+            expect(TestHelpers::writeTone(fileB, 22050.0, 20000 - 4000 * i, 330.0f * (float) (i + 1)));
+
+            kits[0].add({ fileA.getFullPathName(), 53 + 2 * i, 53 + 2 * i, 53 + 2 * i });
+            kits[1].add({ fileB.getFullPathName(), 48 + 3 * i, 50 + 3 * i, 49 + 3 * i });
+        }
+
+        SynthExampleAudioProcessor engine;
+        TestHelpers::setParameter(engine, "mode", (float) noiseMode); // the sampler only plays in noise mode
+        engine.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        engine.prepareToPlay(sampleRate, blockSize);
+        engine.loadSampleKit(kits[0]);
+        expect(engine.waitForSampleKit(10000));
+
+        KitSwapper swapper(engine, kits);
+        swapper.startThread();
+
+        juce::AudioBuffer<float> block(2, blockSize);
+        juce::MidiBuffer midi;
+        midi.ensureSize(4096);
+
+        const auto violationsBefore = AllocationTracer::getViolations();
+        bool finite = true;
+
+        for (int i = 0; i < numBlocks; ++i)
+        {
+            // hits across both kits' ranges, some cut short, some overlapping the next swap
+            midi.clear();
+            const int note = 48 + (i * 7) % 16;
+            midi.addEvent(juce::MidiMessage::noteOn(1, note, (juce::uint8) (40 + i % 80)), (i * 37) % blockSize);
+            if (i % 3 == 0)
+                midi.addEvent(juce::MidiMessage::noteOff(1, 48 + ((i + 5) * 7) % 16), (i * 11) % blockSize);
+
+            block.clear();
+            engine.processBlock(block, midi);
+
+            for (int channel = 0; channel < block.getNumChannels() && finite; ++channel)
+                for (int s = 0; s < blockSize && finite; ++s)
+                    finite = std::isfinite(block.getSample(channel, s));
+        }
+
+        swapper.stopThread(10000);
+
+        expect(finite, "a block rendered a NaN or infinity");
+        expectGreaterThan(swapper.swaps.load(), 20, "the loader thread hardly got to swap kits");
+        expectEquals((int) (AllocationTracer::getViolations() - violationsBefore), 0,
+                     "processBlock allocated, freed or took a shared lock while kits were swapping");
+
+        // the last request wins, whatever was still loading when it came in
+        engine.loadSampleKit(kits[1]);
+        expect(engine.waitForSampleKit(10000));
+        expect(engine.getSampleKit().size() == kits[1].size()
+                 && engine.getSampleKit()[0].source == kits[1][0].source);
+
+        directory.deleteRecursively();
+    }
+
+private:
+    static constexpr double sampleRate = 48000.0;
+    static constexpr int blockSize = 128;
+    static constexpr int numBlocks = 6000; // 16 seconds of audio
+
+    /** Alternates between two kits as fast as they load, like a user clicking through kits. */
+    class KitSwapper : public juce::Thread
+    {
+    public:
+        KitSwapper(SynthExampleAudioProcessor& e, const juce::Array<SampleMapping>* k)
+            : juce::Thread("Kit swapper"), engine(e), kits(k)
+        {
+        }
+
+        void run() override
+        {
+            while (! threadShouldExit())
+            {
+                engine.loadSampleKit(kits[swaps.load() % 2]);
+                ++swaps;
+                wait(1 + swaps.load() % 7);
+            }
+        }
+
+        std::atomic<int> swaps { 0 };
+
+    private:
+        SynthExampleAudioProcessor& engine;
+        const juce::Array<SampleMapping>* kits;
+    };
+};
+
+static SampleKitStressTests sampleKitStressTests;
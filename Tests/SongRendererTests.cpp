@@ -0,0 +1,109 @@
+/*
+  ==============================================================================
+
+    SongRendererTests.cpp
+    Created: 19 Oct 2026 4:20:56am
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "TestHelpers.h"
+#include "../RenderCheck.h"
+#include "../SongRenderer.h"
+
+/**
+ * Renders a song in parallel with SongRenderer and serially with RenderCheck, and expects the same
+ * hash. Patches that settle well inside the song's gaps must not need any chunk rendered twice; how
+ * the song was cut and how much was rendered again is logged for every patch.
+ */
+class SongRendererTests : public juce::UnitTest
+{
+public:
+    SongRendererTests() : juce::UnitTest("Parallel song rendering", "NES Synth") {}
+
+    void runTest() override
+    {
+        const auto song = makeSong();
+
+        beginTest("Dry pulse");
+        expectMatchesSerial(TestHelpers::makeState({}), song, true);
+
+        beginTest("Arpeggiator on");
+        expectMatchesSerial(TestHelpers::makeState({ { "arpEnabled", 0.0f }, { "arpRate", 4.0f } }), song, true);
+
+        beginTest("Bass with reverb");
+        expectMatchesSerial(TestHelpers::makeState({ { "mode", 0.0f }, { "reverbToggle", 1.0f }, { "reverbWet", 0.5f },
+                                                     { "reverbRoomSize", 0.5f } }), song, false);
+
+        beginTest("Noise drums and samples");
+        expectMatchesSerial(TestHelpers::makeState({ { "mode", 2.0f } }), song, false);
+    }
+
+private:
+    static constexpr double sampleRate = 44100.0;
+    static constexpr int blockSize = 512;
+    static constexpr int numPhrases = 5;
+    static constexpr int phraseSamples = 9 * 44100; // 3 seconds of notes, then 6 of quiet
+
+    /**
+     * @param settlesInGaps True if the patch is known to settle within the gaps, so no chunk may have
+     *                      been rendered twice.
+     */
+    void expectMatchesSerial(const juce::MemoryBlock& state, const juce::MidiBuffer& song, bool settlesInGaps)
+    {
+        const int numSamples = numPhrases * phraseSamples;
+
+        SongRenderer renderer;
+        SongRenderer::Settings settings;
+        settings.sampleRate = sampleRate;
+        settings.blockSize = blockSize;
+
+        juce::AudioBuffer<float> parallel;
+        expect(renderer.render(state, song, numSamples, settings, parallel));
+
+        juce::uint64 serialHash = 0;
+        expect(RenderCheck::render(state, song, numSamples, sampleRate, { blockSize }, serialHash));
+        expect(RenderCheck::hash(parallel) == serialHash, "the parallel render differs from the serial one");
+
+        const auto statistics = renderer.getStatistics();
+        logMessage("    " + juce::String(statistics.numChunks) + " chunks, cut at "
+                   + juce::String(statistics.gapSeconds, 2) + " s gaps, "
+                   + juce::String(statistics.chunksRerendered) + " rendered again");
+
+        if (settlesInGaps)
+        {
+            expectGreaterThan(statistics.numChunks, 1, "the song wasn't cut");
+            expectEquals(statistics.chunksRerendered, 0, "a chunk's speculative start was wrong");
+        }
+    }
+
+    /** Phrases of overlapping notes with the pedal and a bend, each followed by a long gap. */
+    static juce::MidiBuffer makeSong()
+    {
+        juce::MidiBuffer midi;
+
+        for (int phrase = 0; phrase < numPhrases; ++phrase)
+        {
+            const int start = phrase * phraseSamples + 123;
+
+            for (int i = 0; i < 12; ++i)
+            {
+                const int note = 48 + (phrase * 3 + i * 5) % 20;
+                const int on = start + i * 11025;
+                midi.addEvent(juce::MidiMessage::noteOn(1, note, (juce::uint8) (60 + 5 * i)), on);
+                midi.addEvent(juce::MidiMessage::noteOff(1, note), on + 16000);
+            }
+
+            midi.addEvent(juce::MidiMessage::controllerEvent(1, 64, 127), start + 30000);
+            midi.addEvent(juce::MidiMessage::controllerEvent(1, 64, 0), start + 60000);
+            midi.addEvent(juce::MidiMessage::pitchWheel(1, 9000), start + 70000);
+            midi.addEvent(juce::MidiMessage::pitchWheel(1, 8192), start + 100000);
+        }
+
+        return midi;
+    }
+};
+
+static SongRendererTests songRendererTests;
@@ -0,0 +1,88 @@
+/*
+  ==============================================================================
+
+    TestHelpers.h
+    Created: 19 Oct 2026 3:16:25am
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "../PluginProcessor.h"
+
+/** What the engine tests share: setting parameters by ID, preset blobs and generated samples. */
+class TestHelpers
+{
+public:
+    /**
+     * Sets one of the engine's parameters, in its own units, as the host would.
+     * @return False if there is no parameter with that ID.
+     */
+    static bool setParameter(juce::AudioProcessor& processor, const juce::String& id, float value)
+    {
+        for (auto* parameter : processor.getParameters())
+        {
+            if (auto* ranged = dynamic_cast<juce::RangedAudioParameter*>(parameter))
+            {
+                if (ranged->getParameterID() == id)
+                {
+                    ranged->setValueNotifyingHost(ranged->convertTo0to1(value));
+                    return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * The plugin state of the default parameters with some changed, for RenderCheck and the renderers.
+     * @param changes Parameter IDs and their values, in the parameters' own units.
+     */
+    static juce::MemoryBlock makeState(std::initializer_list<std::pair<const char*, float>> changes)
+    {
+        SynthExampleAudioProcessor engine(true);
+
+        for (const auto& change : changes)
+            setParameter(engine, change.first, change.second);
+
+        juce::MemoryBlock state;
+        engine.getStateInformation(state);
+        return state;
+    }
+
+    /**
+     * Writes a mono 16-bit WAV of a decaying tone.
+     * @param file Destination, replaced.
+     * @param sampleRate Rate of the file.
+     * @param numSamples Length of the file.
+     * @param frequency Pitch of the tone in Hz.
+     * @return True if the file was written.
+     */
+    static bool writeTone(const juce::File& file, double sampleRate, int numSamples, float frequency)
+    {
+        juce::AudioBuffer<float> tone(1, numSamples);
+
+        for (int i = 0; i < numSamples; ++i)
+            tone.setSample(0, i, 0.5f * std::sin(juce::MathConstants<float>::twoPi * frequency * (float) (i / sampleRate))
+                                   * std::exp(-3.0f * (float) i / (float) numSamples));
+
+        file.deleteFile();
+        auto stream = std::make_unique<juce::FileOutputStream>(file);
+
+        if (! stream->openedOk())
+            return false;
+
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(stream.get(), sampleRate, 1, 16, {}, 0));
+
+        if (writer == nullptr)
+            return false;
+
+        stream.release(); // the writer owns it now
+        return writer->writeFromAudioSampleBuffer(tone, 0, numSamples);
+    }
+};
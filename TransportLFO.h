@@ -0,0 +1,215 @@
+/*
+  ==============================================================================
+
+    TransportLFO.h
+    Created: 19 Oct 2026 1:14:52am
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Basic Oscillator Class.h"
+
+/**
+ * Where the host's transport is at the start of a block, read once per block by the processor and
+ * shared with everything that syncs to it.
+ */
+struct TransportPosition
+{
+    double ppq = 0.0;            // quarter notes at the first sample of the block
+    double beatsPerSample = 0.0; // quarter notes per sample at the current tempo
+
+    // where the transport has been running steadily from, set by FreeRunningPosition::advance
+    double anchorPPQ = 0.0;
+    juce::int64 samplesFromAnchor = 0; // the block's first sample, counted from the anchor
+
+    /**
+     * Quarter notes at a sample of the block, counted from the anchor, so a sample comes out with
+     * exactly the same position however the blocks before it were split.
+     * @param offset Position of the sample in the block.
+     */
+    double ppqAt(int offset) const
+    {
+        return anchorPPQ + (double) (samplesFromAnchor + offset) * beatsPerSample;
+    }
+
+    /**
+     * Reads the host's position and tempo. A stopped host keeps reporting the same position, so its
+     * position is only taken while it plays; otherwise the fallback carries on counting.
+     * @param playHead The host's play head, may be nullptr.
+     * @param sampleRate The audio sample rate.
+     * @param fallbackBPM Tempo to use if the host doesn't give one.
+     * @param fallbackPPQ Position to use if the host doesn't give one or isn't playing, e.g. from the
+     *                    processor's own count.
+     */
+    static TransportPosition read(juce::AudioPlayHead* playHead, double sampleRate, double fallbackBPM, double fallbackPPQ)
+    {
+        double bpm = fallbackBPM;
+        TransportPosition position;
+        position.ppq = fallbackPPQ;
+
+        if (playHead != nullptr)
+        {
+            if (const auto info = playHead->getPosition())
+            {
+                if (info->getIsPlaying())
+                    if (const auto ppq = info->getPpqPosition())
+                        position.ppq = *ppq;
+
+                if (const auto hostBpm = info->getBpm())
+                    bpm = *hostBpm;
+            }
+        }
+
+        position.beatsPerSample = sampleRate > 0.0 ? bpm / (60.0 * sampleRate) : 0.0;
+        position.anchorPPQ = position.ppq;
+        return position;
+    }
+};
+
+/**
+ * The processor's own position, for hosts that don't report one. It is counted in samples since the
+ * tempo last changed rather than summed block by block, so it comes out exactly the same however the
+ * host splits the blocks.
+ *
+ * It also anchors the host's position: as long as the host's blocks follow on from one another at a
+ * steady tempo, every block is placed on the same count, and only a tempo change or a jump (a seek or
+ * a loop) starts a new one.
+ */
+class FreeRunningPosition
+{
+public:
+    /** Quarter notes at the start of the next block. */
+    double getPPQ() const
+    {
+        return anchorPPQ + (double) samplesSinceAnchor * beatsPerSample;
+    }
+
+    /**
+     * Anchors a block and moves on past it.
+     * @param block The block's position, as read with this count as its fallback; its anchor is set.
+     * @param numSamples Length of the block.
+     */
+    void advance(TransportPosition& block, int numSamples)
+    {
+        // within half a sample of where the count says the block starts, it follows on
+        const bool followsOn = std::abs(block.ppq - getPPQ()) <= 0.5 * block.beatsPerSample;
+
+        if (block.beatsPerSample != beatsPerSample || ! followsOn)
+        {
+            anchorPPQ = block.ppq;
+            beatsPerSample = block.beatsPerSample;
+            samplesSinceAnchor = 0;
+        }
+
+        block.anchorPPQ = anchorPPQ;
+        block.samplesFromAnchor = samplesSinceAnchor;
+        samplesSinceAnchor += numSamples;
+    }
+
+    /** Back to the start. */
+    void reset()
+    {
+        anchorPPQ = beatsPerSample = 0.0;
+        samplesSinceAnchor = 0;
+    }
+
+    /**
+     * Moves the count to where it would be had the current tempo held from the start.
+     * @param samplePosition Samples since the start.
+     */
+    void seek(juce::int64 samplePosition)
+    {
+        anchorPPQ = 0.0;
+        samplesSinceAnchor = samplePosition;
+    }
+
+    void saveState(juce::OutputStream& out) const
+    {
+        out.writeDouble(anchorPPQ);
+        out.writeDouble(beatsPerSample);
+        out.writeInt64(samplesSinceAnchor);
+    }
+
+    void restoreState(juce::InputStream& in)
+    {
+        anchorPPQ = in.readDouble();
+        beatsPerSample = in.readDouble();
+        samplesSinceAnchor = in.readInt64();
+    }
+
+private:
+    double anchorPPQ = 0.0, beatsPerSample = 0.0;
+    juce::int64 samplesSinceAnchor = 0;
+};
+
+/**
+ * The bit-depth LFO locked to the transport. Its phase at every sample is worked out from the anchored
+ * position, (ppq / beatsPerCycle) mod 1, rather than accumulated by a free-running Phasor, so it keeps
+ * no state at all: seeks, loops and offline renders produce exactly the same modulation, bit for bit
+ * whatever the block sizes, voices that start late join it in phase, and nothing steps it while no
+ * voice is sounding.
+ *
+ * The shapes and their order are those of the voices' free-running LFOs.
+ */
+class TransportLFO
+{
+public:
+    /** Choices of the lfoSync parameter; the first is the free-running LFO. */
+    static juce::StringArray getSyncNames()
+    {
+        return { "Free", "4 Bars", "1 Bar", "1/2", "1/4", "1/8", "1/16" };
+    }
+
+    /**
+     * @param sync A value of the lfoSync parameter.
+     * @return Quarter notes per LFO cycle, or 0 for the free-running LFO.
+     */
+    static double getBeatsPerCycle(int sync)
+    {
+        static constexpr double beatsPerCycle[] = { 0.0, 16.0, 4.0, 2.0, 1.0, 0.5, 0.25 };
+        return beatsPerCycle[juce::jlimit(0, (int) std::size(beatsPerCycle) - 1, sync)];
+    }
+
+    /**
+     * Renders the LFO for a stretch of the block.
+     * @param shape 0 sine, 1 triangle, 2 square, as the typeLFO switch in the voices.
+     * @param transport The block's transport position.
+     * @param beatsPerCycle From getBeatsPerCycle, above 0.
+     * @param offset Position of the stretch in the block.
+     * @param out Destination.
+     * @param numSamples Length of the stretch.
+     */
+    void render(int shape, const TransportPosition& transport, double beatsPerCycle, int offset, float* out, int numSamples) const
+    {
+        switch (shape)
+        {
+            case 0:  fill(sine, transport, beatsPerCycle, offset, out, numSamples);   break;
+            case 1:  fill(tri, transport, beatsPerCycle, offset, out, numSamples);    break;
+            case 2:  fill(square, transport, beatsPerCycle, offset, out, numSamples); break;
+            default: juce::FloatVectorOperations::clear(out, numSamples); break;
+        }
+    }
+
+private:
+    static uint32_t toPhase(double cycles)
+    {
+        return (uint32_t) (juce::int64) ((cycles - std::floor(cycles)) * 4294967296.0);
+    }
+
+    /** Every sample's phase comes from its own position; stepping from the start of a run would not. */
+    template <typename Waveform>
+    static void fill(const Waveform& waveform, const TransportPosition& transport, double beatsPerCycle, int offset,
+                     float* out, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+            out[i] = waveform.output(toPhase(transport.ppqAt(offset + i) / beatsPerCycle));
+    }
+
+    SinOsc sine;
+    TriLFO tri;
+    SquareOsc square;
+};
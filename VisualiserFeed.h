@@ -0,0 +1,129 @@
+/*
+  ==============================================================================
+
+    VisualiserFeed.h
+    Created: 18 Oct 2026 1:05:37pm
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Wait-free single-producer/single-consumer sample queue carrying audio from the audio thread to the
+ * editor. The audio thread pushes whole blocks and never waits: if the editor has fallen behind and
+ * there isn't room for the block, the block is dropped and counted instead. Nothing is pushed at all
+ * while no editor is listening.
+ */
+class VisualiserFeed
+{
+public:
+    /** Must be a power of two so positions can wrap with a mask. */
+    static constexpr int capacity = 8192;
+
+    /**
+     * Turns the feed on or off. The editor enables it while it's open, so a closed editor costs the
+     * audio thread a single atomic load per block.
+     */
+    void setActive(bool shouldBeActive)
+    {
+        active.store(shouldBeActive, std::memory_order_release);
+    }
+
+    bool isActive() const
+    {
+        return active.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Audio thread: queues a block of samples, or drops it if the reader hasn't made room.
+     * @param samples Mono samples to queue.
+     * @param numSamples Number of samples; blocks larger than the capacity are truncated to their tail.
+     */
+    void push(const float* samples, int numSamples)
+    {
+        if (numSamples > capacity)
+        {
+            samples += numSamples - capacity;
+            numSamples = capacity;
+        }
+
+        const auto write = writePosition.load(std::memory_order_relaxed);
+        const auto read = readPosition.load(std::memory_order_acquire);
+
+        if (capacity - (int) (write - read) < numSamples)
+        {
+            droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        const int start = (int) (write & mask);
+        const int firstPart = numSamples < capacity - start ? numSamples : capacity - start;
+
+        std::memcpy(buffer + start, samples, sizeof (float) * (size_t) firstPart);
+        std::memcpy(buffer, samples + firstPart, sizeof (float) * (size_t) (numSamples - firstPart));
+
+        writePosition.store(write + (uint32_t) numSamples, std::memory_order_release);
+    }
+
+    /**
+     * UI thread: takes up to maxSamples of the oldest queued samples.
+     * @return The number of samples copied into dest.
+     */
+    int pull(float* dest, int maxSamples)
+    {
+        const auto read = readPosition.load(std::memory_order_relaxed);
+        const auto write = writePosition.load(std::memory_order_acquire);
+
+        const int available = (int) (write - read);
+        const int numSamples = available < maxSamples ? available : maxSamples;
+        const int start = (int) (read & mask);
+        const int firstPart = numSamples < capacity - start ? numSamples : capacity - start;
+
+        std::memcpy(dest, buffer + start, sizeof (float) * (size_t) firstPart);
+        std::memcpy(dest + firstPart, buffer, sizeof (float) * (size_t) (numSamples - firstPart));
+
+        readPosition.store(read + (uint32_t) numSamples, std::memory_order_release);
+        return numSamples;
+    }
+
+    /** UI thread: throws away everything queued, e.g. when the editor reopens. */
+    void discard()
+    {
+        readPosition.store(writePosition.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    /** Audio thread: publishes which voices are sounding, one bit per voice. */
+    void setActiveVoices(uint32_t voiceMask)
+    {
+        activeVoices.store(voiceMask, std::memory_order_relaxed);
+    }
+
+    uint32_t getActiveVoices() const
+    {
+        return activeVoices.load(std::memory_order_relaxed);
+    }
+
+    /** Number of blocks the audio thread had to drop because the editor lagged. */
+    uint32_t getDroppedBlocks() const
+    {
+        return droppedBlocks.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr uint32_t mask = (uint32_t) capacity - 1;
+    static_assert((capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+    float buffer[capacity] = {};
+
+    std::atomic<uint32_t> writePosition { 0 };
+    std::atomic<uint32_t> readPosition { 0 };
+    std::atomic<uint32_t> activeVoices { 0 };
+    std::atomic<uint32_t> droppedBlocks { 0 };
+    std::atomic<bool> active { false };
+};
@@ -0,0 +1,255 @@
+/*
+  ==============================================================================
+
+    Visualisers.h
+    Created: 18 Oct 2026 1:31:12pm
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+
+/**
+ * Oscilloscope display. Samples are appended from the editor's timer and the trace is triggered on a
+ * rising zero crossing so that steady notes stand still, which makes duty and crush changes easy to see.
+ * The component only repaints when new samples have arrived since the last frame.
+ */
+class OscilloscopeView : public juce::Component
+{
+public:
+    static constexpr int numPoints = 512;
+
+    OscilloscopeView()
+    {
+        setOpaque(true);
+    }
+
+    /**
+     * Appends new samples to the history.
+     * @param samples Mono samples pulled from the visualiser feed.
+     * @param numSamples Number of samples.
+     */
+    void pushSamples(const float* samples, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            history[writeIndex] = samples[i];
+            writeIndex = (writeIndex + 1) % historySize;
+        }
+
+        dirty = numSamples > 0 || dirty;
+    }
+
+    /** Repaints if anything changed since the last call. Called once per editor frame. */
+    void refresh()
+    {
+        if (dirty)
+        {
+            dirty = false;
+            repaint();
+        }
+    }
+
+    void paint(juce::Graphics& g) override
+    {
+        g.fillAll(juce::Colours::black);
+
+        const auto bounds = getLocalBounds().toFloat();
+        const float midY = bounds.getCentreY();
+
+        g.setColour(juce::Colours::darkgrey);
+        g.drawHorizontalLine((int) midY, bounds.getX(), bounds.getRight());
+
+        // look back from the oldest sample that still leaves a full trace for a rising zero crossing
+        int start = (writeIndex + historySize - 2 * numPoints) % historySize;
+        for (int i = 0; i < numPoints; ++i)
+        {
+            const int index = (start + i) % historySize;
+            if (history[index] <= 0.0f && history[(index + 1) % historySize] > 0.0f)
+            {
+                start = index;
+                break;
+            }
+        }
+
+        juce::Path trace;
+        trace.preallocateSpace(3 * numPoints);
+
+        for (int i = 0; i < numPoints; ++i)
+        {
+            const float x = bounds.getX() + bounds.getWidth() * (float) i / (float) (numPoints - 1);
+            const float y = midY - juce::jlimit(-1.0f, 1.0f, history[(start + i) % historySize]) * bounds.getHeight() * 0.45f;
+
+            if (i == 0)
+                trace.startNewSubPath(x, y);
+            else
+                trace.lineTo(x, y);
+        }
+
+        g.setColour(juce::Colours::lightgreen);
+        g.strokePath(trace, juce::PathStrokeType(1.5f));
+    }
+
+private:
+    static constexpr int historySize = 3 * numPoints;
+
+    float history[historySize] = {};
+    int writeIndex = 0;
+    bool dirty = false;
+};
+
+//==============================================================================
+/**
+ * Log-frequency magnitude spectrum. Samples are collected into an FFT frame on the UI thread and a new
+ * spectrum is only computed, and the component only repainted, when a full frame has been collected.
+ */
+class SpectrumView : public juce::Component
+{
+public:
+    static constexpr int fftOrder = 11;
+    static constexpr int fftSize = 1 << fftOrder;
+
+    SpectrumView()
+    {
+        setOpaque(true);
+    }
+
+    /** Sets the sample rate used to place the frequency axis. */
+    void setSampleRate(double newSampleRate)
+    {
+        sampleRate = newSampleRate > 0.0 ? newSampleRate : 44100.0;
+    }
+
+    /**
+     * Collects samples and runs the FFT whenever a frame is complete.
+     * @param samples Mono samples pulled from the visualiser feed.
+     * @param numSamples Number of samples.
+     */
+    void pushSamples(const float* samples, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            frame[frameIndex++] = samples[i];
+
+            if (frameIndex == fftSize)
+            {
+                frameIndex = 0;
+                std::copy(frame, frame + fftSize, fftData);
+                std::fill(fftData + fftSize, fftData + 2 * fftSize, 0.0f);
+
+                window.multiplyWithWindowingTable(fftData, (size_t) fftSize);
+                fft.performFrequencyOnlyForwardTransform(fftData);
+
+                for (int bin = 0; bin < fftSize / 2; ++bin)
+                    levels[bin] = juce::Decibels::gainToDecibels(fftData[bin] / (float) fftSize, minDecibels);
+
+                dirty = true;
+            }
+        }
+    }
+
+    /** Repaints if a new spectrum was computed since the last call. */
+    void refresh()
+    {
+        if (dirty)
+        {
+            dirty = false;
+            repaint();
+        }
+    }
+
+    void paint(juce::Graphics& g) override
+    {
+        g.fillAll(juce::Colours::black);
+
+        const auto bounds = getLocalBounds().toFloat();
+        const float minFrequency = 20.0f;
+        const float maxFrequency = (float) sampleRate * 0.5f;
+        const float logRange = std::log(maxFrequency / minFrequency);
+
+        juce::Path spectrum;
+        spectrum.preallocateSpace(3 * (int) bounds.getWidth());
+
+        for (int x = 0; x < (int) bounds.getWidth(); ++x)
+        {
+            // one point per pixel column, spaced logarithmically in frequency
+            const float frequency = minFrequency * std::exp(logRange * (float) x / bounds.getWidth());
+            const int bin = juce::jlimit(0, fftSize / 2 - 1, (int) (frequency * (float) fftSize / (float) sampleRate));
+            const float level = juce::jlimit(0.0f, 1.0f, 1.0f - levels[bin] / minDecibels);
+            const float y = bounds.getBottom() - level * bounds.getHeight();
+
+            if (x == 0)
+                spectrum.startNewSubPath(bounds.getX(), y);
+            else
+                spectrum.lineTo(bounds.getX() + (float) x, y);
+        }
+
+        g.setColour(juce::Colours::orange);
+        g.strokePath(spectrum, juce::PathStrokeType(1.0f));
+    }
+
+private:
+    static constexpr float minDecibels = -90.0f;
+
+    juce::dsp::FFT fft { fftOrder };
+    juce::dsp::WindowingFunction<float> window { (size_t) fftSize, juce::dsp::WindowingFunction<float>::hann };
+
+    float frame[fftSize] = {};
+    float fftData[2 * fftSize] = {};
+    float levels[fftSize / 2] = {};
+    int frameIndex = 0;
+    double sampleRate = 44100.0;
+    bool dirty = false;
+};
+
+//==============================================================================
+/**
+ * One cell per synth voice, lit while the voice is sounding. Only cells whose state changed are
+ * repainted.
+ */
+class VoiceActivityView : public juce::Component
+{
+public:
+    explicit VoiceActivityView(int _numVoices) : numVoices(juce::jlimit(1, 32, _numVoices))
+    {
+        setOpaque(true);
+    }
+
+    /**
+     * Updates the display from the voice bitmask published by the processor.
+     * @param voiceMask One bit per voice, set while that voice is active.
+     */
+    void setActiveVoices(juce::uint32 voiceMask)
+    {
+        const auto changed = voiceMask ^ activeVoices;
+        activeVoices = voiceMask;
+
+        for (int i = 0; i < numVoices; ++i)
+            if ((changed >> i) & 1u)
+                repaint(getCellBounds(i));
+    }
+
+    void paint(juce::Graphics& g) override
+    {
+        g.fillAll(juce::Colours::black);
+
+        for (int i = 0; i < numVoices; ++i)
+        {
+            g.setColour(((activeVoices >> i) & 1u) ? juce::Colours::lightgreen : juce::Colours::darkgrey);
+            g.fillRect(getCellBounds(i).reduced(2));
+        }
+    }
+
+private:
+    juce::Rectangle<int> getCellBounds(int voice) const
+    {
+        const int cellWidth = getWidth() / numVoices;
+        return { voice * cellWidth, 0, cellWidth, getHeight() };
+    }
+
+    int numVoices;
+    juce::uint32 activeVoices = 0;
+};
@@ -0,0 +1,206 @@
+/*
+  ==============================================================================
+
+    Wavetable.h
+    Created: 18 Oct 2026 10:03:48pm
+    Author:  Caitlin Earley
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include "FrameSequencer.h"
+
+/**
+ * One looped waveform for WavetableOsc: up to 256 steps, played back without interpolation like the
+ * sequencers on the chips themselves.
+ */
+struct Wavetable
+{
+    static constexpr int maxLength = 256;
+
+    std::array<float, maxLength> steps {};
+    int length = 1;
+};
+
+/**
+ * Waveforms and pitch tables for the Famicom expansion chips, shared by every voice through
+ * VoiceResources.
+ *
+ * VRC6 adds two pulses with eight duties (1/16 to 8/16) on 16-step sequencers, and a sawtooth built
+ * from an accumulator stepped seven times per cycle; both run off 12-bit timers. Namco 163 plays 4-bit
+ * wavetables from its internal RAM on up to eight channels, which it serves one at a time, so each
+ * channel's 18-bit frequency register is divided by the number of enabled channels.
+ *
+ * The waveforms don't depend on the sample rate and are built once. prepare() rebuilds the pitch tables
+ * for a rate, so a note on or a bend costs one lookup or one multiply.
+ */
+class ExpansionTables
+{
+public:
+    static constexpr double cpuClock = FrameSequencer::cpuClock; // the expansion chips run off the console's clock
+
+    static constexpr int numVrc6Duties = 8;
+    static constexpr int numVrc6Periods = 0x1000;
+    static constexpr int maxVrc6Period = numVrc6Periods - 1;
+
+    static constexpr int maxN163Channels = 8;
+    static constexpr int maxN163Frequency = 0x3ffff;
+    static constexpr int n163WaveLength = 32;
+
+    enum N163Wave { sine, triangle, sawtooth, square, organ, numN163Waves };
+
+    ExpansionTables()
+    {
+        buildWaves();
+        prepare(44100.0);
+    }
+
+    /**
+     * Rebuilds the pitch tables for a sample rate.
+     * @param sampleRate The audio sample rate.
+     */
+    void prepare(double sampleRate)
+    {
+        // the VRC6 pulse steps its 16-step sequencer once per timer period, the saw steps its
+        // accumulator every other period for seven steps, 14 periods per cycle
+        for (int note = 0; note < 128; ++note)
+        {
+            const double frequency = 440.0 * std::pow(2.0, (note - 69) / 12.0);
+            vrc6PulsePeriods[(size_t) note] = clampPeriod(cpuClock / (16.0 * frequency) - 1.0);
+            vrc6SawPeriods[(size_t) note] = clampPeriod(cpuClock / (14.0 * frequency) - 1.0);
+        }
+
+        for (int period = 0; period < numVrc6Periods; ++period)
+        {
+            vrc6PulseIncrements[(size_t) period] = toPhaseIncrement(cpuClock / (16.0 * (period + 1)) / sampleRate);
+            vrc6SawIncrements[(size_t) period] = toPhaseIncrement(cpuClock / (14.0 * (period + 1)) / sampleRate);
+        }
+
+        // N163: f = cpu * F / (15 * 65536 * channels * length)
+        for (int channels = 1; channels <= maxN163Channels; ++channels)
+        {
+            const double hzPerUnit = cpuClock / (15.0 * 65536.0 * channels * n163WaveLength);
+            n163UnitsPerHz[(size_t) channels - 1] = 1.0 / hzPerUnit;
+            n163IncrementPerUnit[(size_t) channels - 1] = hzPerUnit / sampleRate * 4294967296.0;
+        }
+    }
+
+    /** @return The VRC6 pulse timer period closest to a MIDI note. */
+    int getVrc6PulsePeriod(int midiNote) const { return vrc6PulsePeriods[(size_t) (midiNote & 127)]; }
+
+    /** @return The VRC6 sawtooth timer period closest to a MIDI note. */
+    int getVrc6SawPeriod(int midiNote) const { return vrc6SawPeriods[(size_t) (midiNote & 127)]; }
+
+    /** @return Phase increment per sample for a VRC6 pulse timer period. */
+    uint32_t getVrc6PulseIncrement(int period) const { return vrc6PulseIncrements[(size_t) (period & maxVrc6Period)]; }
+
+    /** @return Phase increment per sample for a VRC6 sawtooth timer period. */
+    uint32_t getVrc6SawIncrement(int period) const { return vrc6SawIncrements[(size_t) (period & maxVrc6Period)]; }
+
+    /**
+     * Pitch of an N163 channel, rounded to what its frequency register can hold.
+     * @param frequency Wanted frequency in Hz.
+     * @param numChannels Enabled N163 channels, 1 to 8; more channels mean less range at the top.
+     * @return Phase increment per sample.
+     */
+    uint32_t getN163Increment(float frequency, int numChannels) const
+    {
+        const size_t index = (size_t) (numChannels < 1 ? 0 : (numChannels > maxN163Channels ? maxN163Channels - 1 : numChannels - 1));
+        const double units = std::fmin(std::floor(frequency * n163UnitsPerHz[index] + 0.5), (double) maxN163Frequency);
+        return (uint32_t) (units * n163IncrementPerUnit[index]);
+    }
+
+    /**
+     * Moves a 12-bit timer period by a frequency ratio, rounding to a period the chip can play.
+     * @param period Starting timer period.
+     * @param ratio Frequency ratio, above 1 to go up in pitch.
+     */
+    static int transposePeriod(int period, float ratio)
+    {
+        return clampPeriod((double) (period + 1) / ratio - 1.0);
+    }
+
+    /** @param duty 1 to 8 sixteenths of the cycle high. */
+    const Wavetable& getVrc6Pulse(int duty) const
+    {
+        return vrc6Pulses[(size_t) (duty < 1 ? 0 : (duty > numVrc6Duties ? numVrc6Duties - 1 : duty - 1))];
+    }
+
+    const Wavetable& getVrc6Saw() const { return vrc6Saw; }
+
+    const Wavetable& getN163Wave(int wave) const
+    {
+        return n163Waves[(size_t) (wave < 0 ? 0 : (wave >= numN163Waves ? numN163Waves - 1 : wave))];
+    }
+
+private:
+    void buildWaves()
+    {
+        for (int duty = 1; duty <= numVrc6Duties; ++duty)
+        {
+            auto& table = vrc6Pulses[(size_t) duty - 1];
+            table.length = 16;
+
+            for (int step = 0; step < 16; ++step)
+                table.steps[(size_t) step] = step < duty ? 0.5f : -0.5f;
+        }
+
+        // accumulator rate 42, the largest that doesn't wrap, and the top five of its eight bits
+        vrc6Saw.length = 7;
+        for (int step = 0; step < 7; ++step)
+            vrc6Saw.steps[(size_t) step] = (float) ((step * 42) >> 3) / 31.0f - 0.5f;
+
+        // the 4-bit waves that ship with most N163 drivers' default instruments
+        for (int wave = 0; wave < numN163Waves; ++wave)
+        {
+            auto& table = n163Waves[(size_t) wave];
+            table.length = n163WaveLength;
+
+            for (int step = 0; step < n163WaveLength; ++step)
+            {
+                const double x = (double) step / n163WaveLength;
+                double value = 0.0; // -1 to 1
+
+                switch (wave)
+                {
+                    case sine:     value = std::sin(2.0 * 3.14159265358979 * x); break;
+                    case triangle: value = x < 0.5 ? 4.0 * x - 1.0 : 3.0 - 4.0 * x; break;
+                    case sawtooth: value = 2.0 * x - 1.0; break;
+                    case square:   value = x < 0.5 ? 1.0 : -1.0; break;
+                    case organ:
+                        value = (std::sin(2.0 * 3.14159265358979 * x) + 0.5 * std::sin(4.0 * 3.14159265358979 * x)
+                                  + 0.25 * std::sin(8.0 * 3.14159265358979 * x)) / 1.4;
+                        break;
+                    default: break;
+                }
+
+                const double level = std::floor((std::fmax(-1.0, std::fmin(1.0, value)) + 1.0) * 7.5 + 0.5);
+                table.steps[(size_t) step] = (float) (level / 15.0 - 0.5);
+            }
+        }
+    }
+
+    static uint32_t toPhaseIncrement(double cyclesPerSample)
+    {
+        const double increment = cyclesPerSample * 4294967296.0 + 0.5;
+        return increment >= 4294967295.0 ? 0xffffffffu : (uint32_t) increment;
+    }
+
+    static int clampPeriod(double period)
+    {
+        return period < 0.0 ? 0 : (period > maxVrc6Period ? maxVrc6Period : (int) (period + 0.5));
+    }
+
+    std::array<Wavetable, numVrc6Duties> vrc6Pulses;
+    Wavetable vrc6Saw;
+    std::array<Wavetable, numN163Waves> n163Waves;
+
+    std::array<int, 128> vrc6PulsePeriods {}, vrc6SawPeriods {};
+    std::array<uint32_t, numVrc6Periods> vrc6PulseIncrements {}, vrc6SawIncrements {};
+    std::array<double, maxN163Channels> n163UnitsPerHz {}, n163IncrementPerUnit {};
+};